@@ -28,4 +28,16 @@ SOURCES += \
 
 HEADERS += \
 	buffer.h \
-	filter.h
+	filter.h \
+	simd.h \
+	fixed.h \
+	convolution.h \
+	filterbank.h \
+	pipeline.h \
+	plan.h \
+	parallel.h \
+	ingest.h \
+	resample.h \
+	mapped.h \
+	record.h \
+	profile.h
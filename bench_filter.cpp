@@ -0,0 +1,942 @@
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#include "fixed.h"
+#include "buffer.h"
+#include "filter.h"
+#include "convolution.h"
+#include "filterbank.h"
+#include "pipeline.h"
+#include "plan.h"
+#include "parallel.h"
+#include "ingest.h"
+#include "resample.h"
+#include "mapped.h"
+#include "record.h"
+
+using namespace std;
+using namespace FilterLib;
+
+// storage of Buffer<T> before the ring rewrite, kept for comparison
+template<typename T>
+class DequeBuffer :
+	public ProcessChain<T>,
+	public std::deque<T>
+{
+public:
+	DequeBuffer(size_t size, ProcessChain<T>* parent = nullptr) :
+		ProcessChain<T>(parent),
+		std::deque<T>(size, Buffer_T<T>::zero)
+	{
+
+	}
+
+	inline T out() const override {
+		return std::deque<T>::front();
+	}
+
+protected:
+	inline T process(const T& input) override {
+		std::deque<T>::pop_back();
+		std::deque<T>::emplace_front(input);
+		return input;
+	}
+};
+
+// MidAntiJitter before the skiplist, copying and sorting every window
+template<typename T>
+class SortMidAntiJitter :
+	public Filter<T>
+{
+public:
+	SortMidAntiJitter(size_t size, ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent),
+		m_input(size)
+	{
+
+	}
+
+protected:
+	Buffer<T> m_input;
+	std::vector<T> m_tmpBuf;
+
+	inline T process(const T& input) override {
+		m_input.in(input);
+		m_input.to(m_tmpBuf);
+		std::sort(m_tmpBuf.begin(), m_tmpBuf.end());
+		return m_tmpBuf[m_input.size() / 2];
+	}
+};
+
+static volatile float g_sink;
+
+template<typename Func>
+double nsPerSample(size_t samples, Func func)
+{
+	auto t0 = chrono::steady_clock::now();
+	for (size_t i = 0; i < samples; ++i)
+		func(i);
+	auto t1 = chrono::steady_clock::now();
+	return chrono::duration<double, nano>(t1 - t0).count() / samples;
+}
+
+template<typename B>
+void benchBuffer(B& buffer, size_t samples, double& push, double& read)
+{
+	push = nsPerSample(samples, [&](size_t i) {
+		buffer.in(float(i));
+	});
+	g_sink = buffer.out();
+
+	// one push and a few scattered reads, as filters and charting do
+	size_t size = buffer.size();
+	read = nsPerSample(samples, [&](size_t i) {
+		buffer.in(float(i));
+		g_sink = buffer.at(size / 2) + buffer.at(size - 1) + buffer.at(i % size);
+	});
+}
+
+// ns per frame of 256 channels, one node per channel against one bank
+template<typename Node, typename Bank, typename Make>
+void benchBank(const char* name, Bank& bank, Make make, size_t frames)
+{
+	const size_t channels = bank.channels();
+	std::vector<std::unique_ptr<Node>> nodes;
+	for (size_t c = 0; c < channels; ++c)
+		nodes.emplace_back(make());
+	std::vector<float> frame(channels);
+	for (size_t c = 0; c < channels; ++c)
+		frame[c] = float(c & 15);
+	double single = nsPerSample(frames, [&](size_t i) {
+		frame[i % channels] = float(i & 31);
+		for (size_t c = 0; c < channels; ++c)
+			g_sink = nodes[c]->in(frame[c]);
+	});
+	double banked = nsPerSample(frames, [&](size_t i) {
+		frame[i % channels] = float(i & 31);
+		g_sink = bank.in(frame.data())[0];
+	});
+	cout << setw(12) << name << fixed << setprecision(2)
+		<< setw(12) << single << setw(12) << banked << endl;
+}
+
+template<typename Node>
+double benchFalling(size_t size, size_t samples)
+{
+	Node node(size);
+	return nsPerSample(samples, [&](size_t i) {
+		g_sink = node.in(-float(i));
+	});
+}
+
+struct NodeResult {
+	const char* node;
+	size_t window; // 0 for nodes without one
+	double ns;
+};
+
+// one noisy signal through every node type at every window size
+// push and sample(2.5) on Buffer and StaticBuffer, HoldHigh with the
+// window as argument and as template argument, one table row
+template<size_t N>
+void benchStatic(size_t samples)
+{
+	Buffer<float> buffer(N);
+	StaticBuffer<float, N> ring;
+	HoldHigh<float> high(N);
+	HoldHigh<float, N> fixedHigh;
+	auto sampled = [&](Buffer<float>& b) {
+		return nsPerSample(samples, [&](size_t i) {
+			b.in(float(i & 1023));
+			g_sink = b.sample(2.5f);
+		});
+	};
+	auto held = [&](ProcessChain<float>& f) {
+		return nsPerSample(samples, [&](size_t i) {
+			g_sink = f.in(float((i * 7919) % 1009));
+		});
+	};
+	double heap = sampled(buffer);
+	// through the concrete type, as code knowing N calls it
+	double inlined = nsPerSample(samples, [&](size_t i) {
+		ring.in(float(i & 1023));
+		g_sink = ring.sample(2.5f);
+	});
+	cout << setw(10) << N << fixed << setprecision(2) << setw(12) << heap
+		<< setw(14) << inlined << setw(12) << held(high) << setw(14) << held(fixedHigh) << endl;
+}
+
+// per call latency of in() on one node, sorted: p50, p99, p99.9 and the
+// worst of samples calls in ns, clock overhead included
+void benchLatency(const char* name, ProcessChain<float>& node, size_t samples)
+{
+	std::vector<double> ns(samples);
+	node.prepare(1);
+	for (size_t i = 0; i < 4096; ++i)
+		g_sink = node.in(float((i * 7919) % 1009) - 504.f);
+	for (size_t i = 0; i < samples; ++i) {
+		float input = float((i * 7919) % 1009) - 504.f;
+		auto t0 = chrono::steady_clock::now();
+		g_sink = node.in(input);
+		auto t1 = chrono::steady_clock::now();
+		ns[i] = chrono::duration<double, nano>(t1 - t0).count();
+	}
+	std::sort(ns.begin(), ns.end());
+	auto at = [&](double q) { return ns[std::min(samples - 1, size_t(q * double(samples)))]; };
+	cout << setw(22) << name << fixed << setprecision(0) << setw(10) << at(0.5)
+		<< setw(10) << at(0.99) << setw(10) << at(0.999) << setw(12) << ns.back() << endl;
+}
+
+// bulk mix of n values through every kernel of T, ns per value
+template<typename T>
+void benchMix(const char* name, size_t n, size_t samples)
+{
+	std::vector<T> a(n), b(n), output(n);
+	std::vector<float> u(n);
+	for (size_t i = 0; i < n; ++i) {
+		a[i] = T(sinf(float(i)) * 0.5f);
+		b[i] = T(cosf(float(i)) * 0.5f);
+		u[i] = float((i * 37) % 101) / 100.f;
+	}
+	cout << setw(8) << name << fixed << setprecision(3);
+	for (auto isa : { simd::Scalar, simd::SSE2, simd::AVX2, simd::AVX512 }) {
+		auto kernel = simd::Kernel<T>::mix(isa);
+		cout << setw(12) << nsPerSample(samples / n, [&](size_t) {
+			kernel(a.data(), b.data(), u.data(), output.data(), n);
+			g_sink = float(double(output[n / 2]));
+		}) / double(n);
+	}
+	cout << endl;
+}
+
+// the same nodes on each value type, ns per sample
+template<typename T>
+void benchValueType(const char* name, size_t samples)
+{
+	std::vector<T> taps(64, T(1. / 64));
+	EMAFilter<T> ema(0.1f);
+	FIRFilter<T> fir(64);
+	MidAntiJitter<T> median(63);
+	fir.setCoeff(taps.data());
+	auto input = [](size_t i) { return T(double((i * 7919) % 1009) / 1024. - 0.5); };
+	cout << setw(8) << name << fixed << setprecision(2);
+	cout << setw(12) << nsPerSample(samples, [&](size_t i) {
+		g_sink = float(double(ema.in(input(i))));
+	});
+	cout << setw(12) << nsPerSample(samples / 4, [&](size_t i) {
+		g_sink = float(double(fir.in(input(i))));
+	});
+	cout << setw(12) << nsPerSample(samples / 4, [&](size_t i) {
+		g_sink = float(double(median.in(input(i))));
+	}) << endl;
+}
+
+std::vector<NodeResult> benchNodes(size_t samples)
+{
+	std::vector<NodeResult> results;
+	std::vector<float> noise(4096);
+	for (size_t i = 0; i < noise.size(); ++i)
+		noise[i] = float((i * 7919) % 1009) - 504.f;
+	auto signal = [&](size_t i) { return noise[i & 4095]; };
+
+	auto run = [&](const char* name, size_t window, ProcessChain<float>& node) {
+		double ns = nsPerSample(samples, [&](size_t i) {
+			g_sink = node.in(signal(i));
+		});
+		results.push_back({ name, window, ns });
+	};
+
+	{
+		Comparator<float> comparator;
+		comparator.setThreshold(-100.f, 100.f);
+		run("Comparator", 0, comparator);
+		Limiter<float> limiter;
+		limiter.setLimit(-100.f, 100.f);
+		run("Limiter", 0, limiter);
+	}
+	for (size_t window : { 8, 64, 512, 4096, 65536 }) {
+		Buffer<float> buffer(window);
+		run("Buffer", window, buffer);
+
+		Buffer<float> time(window);
+		NuBuffer<float> values(window, &time);
+		float now = 0.f;
+		for (size_t i = 0; i < window; ++i) {
+			now += 0.5f + float(i % 3) * 0.25f;
+			time.in(now);
+			values.in(signal(i));
+		}
+		float span = values.span(), oldest = time.back();
+		double ns = nsPerSample(samples, [&](size_t i) {
+			g_sink = values.seek(oldest + span * float((i * 7919) % 4096) / 4096.f, Linear);
+		});
+		results.push_back({ "NuBuffer::seek", window, ns });
+
+		HoldHigh<float> high(window);
+		run("HoldHigh", window, high);
+		HoldLow<float> low(window);
+		run("HoldLow", window, low);
+		MidAntiJitter<float> mid(window);
+		run("MidAntiJitter", window, mid);
+		HistAntiJitter<float> hist(window, 256, -512.f, 512.f);
+		run("HistAntiJitter", window, hist);
+	}
+	return results;
+}
+
+void writeJson(std::ostream& out, const std::vector<NodeResult>& results, size_t samples)
+{
+	out << "{" << endl;
+	out << "  \"benchmark\": \"bench_filter\"," << endl;
+	out << "  \"value_type\": \"float\"," << endl;
+	out << "  \"samples\": " << samples << "," << endl;
+	out << "  \"results\": [" << endl;
+	for (size_t i = 0; i < results.size(); ++i) {
+		const NodeResult& r = results[i];
+		out << "    { \"node\": \"" << r.node << "\", \"window\": " << r.window
+			<< ", \"ns_per_sample\": " << fixed << setprecision(3) << r.ns
+			<< ", \"samples_per_sec\": " << setprecision(0) << 1e9 / r.ns << " }"
+			<< ((i + 1 < results.size()) ? "," : "") << endl;
+	}
+	out << "  ]" << endl;
+	out << "}" << endl;
+}
+
+// bench_filter [--json FILE] [--samples N]: without --json all comparison
+// tables, with it only the node table, written as JSON to FILE (- for
+// stdout)
+int main(int argc, char *argv[])
+{
+	std::string json;
+	size_t nodeSamples = 1 << 20;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		if (arg == "--json")
+			json = argv[i + 1];
+		else if (arg == "--samples")
+			nodeSamples = size_t(std::stoull(argv[i + 1]));
+	}
+	if (!json.empty()) {
+		auto results = benchNodes(nodeSamples);
+		if (json == "-") {
+			writeJson(cout, results, nodeSamples);
+		} else {
+			std::ofstream file(json);
+			writeJson(file, results, nodeSamples);
+			if (!file) {
+				cerr << "cannot write " << json << endl;
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	const size_t samples = 1 << 22;
+
+	cout << "Node ns/sample and Msamples/s on noise" << endl;
+	cout << setw(16) << "node" << setw(8) << "window" << setw(12) << "ns" << setw(12) << "Msps" << endl;
+	for (auto& r : benchNodes(nodeSamples)) {
+		cout << setw(16) << r.node << setw(8) << r.window << fixed << setprecision(2)
+			<< setw(12) << r.ns << setw(12) << 1e3 / r.ns << endl;
+	}
+	cout << endl;
+
+	cout << "Buffer<float> ns/sample (push | push + 3 x at)" << endl;
+	cout << setw(8) << "window"
+		<< setw(12) << "deque" << setw(12) << "ring"
+		<< setw(12) << "deque" << setw(12) << "ring" << endl;
+
+	for (size_t size : { 8, 64, 512, 4096, 32768, 65536 }) {
+		double dequePush, dequeRead, ringPush, ringRead;
+		{
+			DequeBuffer<float> buffer(size);
+			benchBuffer(buffer, samples, dequePush, dequeRead);
+		}
+		{
+			Buffer<float> buffer(size);
+			benchBuffer(buffer, samples, ringPush, ringRead);
+		}
+		cout << setw(8) << size << fixed << setprecision(2)
+			<< setw(12) << dequePush << setw(12) << ringPush
+			<< setw(12) << dequeRead << setw(12) << ringRead << endl;
+	}
+
+	cout << endl;
+	cout << "HoldHigh<float> ns/sample on a falling signal" << endl;
+	cout << setw(8) << "window" << setw(12) << "scan" << setw(12) << "deque" << endl;
+	for (size_t size : { 8, 64, 512, 4096 }) {
+		size_t n = samples / std::max(size_t(1), size / 64);
+		double scan = benchFalling<ScanHoldHigh<float>>(size, n);
+		double deque = benchFalling<HoldHigh<float>>(size, samples);
+		cout << setw(8) << size << fixed << setprecision(2)
+			<< setw(12) << scan << setw(12) << deque << endl;
+	}
+
+	cout << endl;
+	cout << "MidAntiJitter<float> ns/sample on noise" << endl;
+	cout << setw(8) << "window" << setw(12) << "sort"
+		<< setw(12) << "array" << setw(12) << "skiplist" << endl;
+	for (size_t size : { 8, 64, 512, 4096, 16384, 65536 }) {
+		size_t n = samples / std::max(size_t(1), size / 8);
+		SortMidAntiJitter<float> sort(size);
+		SortedArray<float> array(size);
+		IndexableSkiplist<float> skiplist(size);
+		RingBuffer<float> window(size, 0.f), listWindow(size, 0.f);
+		for (size_t i = 0; i < size; ++i) {
+			array.insert(0.f);
+			skiplist.insert(0.f);
+		}
+		double sorted = (size > 4096) ? NAN : nsPerSample(n, [&](size_t i) {
+			g_sink = sort.in(float((i * 7919) % 1009));
+		});
+		double moved = nsPerSample(samples / 8, [&](size_t i) {
+			float value = float((i * 7919) % 1009);
+			array.replace(window.back(), value);
+			window.push(value);
+			g_sink = array.at(size / 2);
+		});
+		double indexed = nsPerSample(samples / 8, [&](size_t i) {
+			float value = float((i * 7919) % 1009);
+			skiplist.erase(listWindow.back());
+			listWindow.push(value);
+			skiplist.insert(value);
+			g_sink = skiplist.at(size / 2);
+		});
+		cout << setw(8) << size << fixed << setprecision(2)
+			<< setw(12) << sorted << setw(12) << moved << setw(12) << indexed << endl;
+	}
+
+	cout << endl;
+	cout << "HistAntiJitter ns/sample on noise, window 256" << endl;
+	cout << setw(8) << "bins" << setw(12) << "float" << setw(12) << "int" << endl;
+	for (size_t bins : { 16, 256, 4096, 65536 }) {
+		HistAntiJitter<float> floats(256, bins, -512.f, 512.f);
+		HistAntiJitter<int> ints(256, bins, -512, 512);
+		double f = nsPerSample(samples, [&](size_t i) {
+			g_sink = floats.in(float((i * 7919) % 1009) - 504.f);
+		});
+		double d = nsPerSample(samples, [&](size_t i) {
+			g_sink = ints.in(int((i * 7919) % 1009) - 504);
+		});
+		cout << setw(8) << bins << fixed << setprecision(2)
+			<< setw(12) << f << setw(12) << d << endl;
+	}
+
+	cout << endl;
+	cout << "FIRFilter<float> ns/sample per kernel" << endl;
+	cout << setw(8) << "taps" << setw(12) << "scalar" << setw(12) << "sse2"
+		<< setw(12) << "avx2" << setw(12) << "avx512" << endl;
+	for (size_t taps : { 64, 256, 1024 }) {
+		std::vector<float> coeff(taps, 1.f / taps);
+		cout << setw(8) << taps << fixed << setprecision(2);
+		for (auto isa : { simd::Scalar, simd::SSE2, simd::AVX2, simd::AVX512 }) {
+			FIRFilter<float> fir(taps);
+			fir.setCoeff(coeff.data());
+			fir.setIsa(isa);
+			cout << setw(12) << nsPerSample(samples / 16, [&](size_t i) {
+				g_sink = fir.in(float(i & 255));
+			});
+		}
+		cout << endl;
+	}
+
+	cout << endl;
+	cout << "IIRFilter<float> ns/sample, Butterworth lowpass" << endl;
+	cout << setw(8) << "order" << setw(12) << "sample" << setw(12) << "block" << endl;
+	for (size_t sections : { 1, 2, 4, 8 }) {
+		IIRFilter<float> single(sections), blocked(sections);
+		single.setButterworthLowpass(0.05);
+		blocked.setButterworthLowpass(0.05);
+		std::vector<float> input(256);
+		for (size_t i = 0; i < input.size(); ++i)
+			input[i] = float(i & 15);
+		double perSample = nsPerSample(samples, [&](size_t i) {
+			g_sink = single.in(float(i & 15));
+		});
+		double perBlock = nsPerSample(samples / input.size(), [&](size_t) {
+			g_sink = blocked.in(input.data(), input.size())[0];
+		}) / input.size();
+		cout << setw(8) << 2 * sections << fixed << setprecision(2)
+			<< setw(12) << perSample << setw(12) << perBlock << endl;
+	}
+
+	cout << endl;
+	cout << "ConvolutionFilter<float> ns/sample, direct against partitioned" << endl;
+	cout << setw(8) << "taps" << setw(12) << "direct"
+		<< setw(12) << "lat 64" << setw(12) << "lat 256" << endl;
+	for (size_t taps : { 16, 32, 64, 128, 256, 512, 1024, 4096, 16384 }) {
+		std::vector<float> coeff(taps, 1.f / taps), input(1024);
+		for (size_t i = 0; i < input.size(); ++i)
+			input[i] = float(i & 255);
+		cout << setw(8) << taps << fixed << setprecision(2);
+		ConvolutionFilter<float> direct(coeff.data(), taps, 64, Direct);
+		ConvolutionFilter<float> fft64(coeff.data(), taps, 64, Partitioned);
+		ConvolutionFilter<float> fft256(coeff.data(), taps, 256, Partitioned);
+		for (ConvolutionFilter<float>* filter : { &direct, &fft64, &fft256 }) {
+			size_t n = samples / std::max(size_t(16), taps / 8);
+			cout << setw(12) << nsPerSample(n / input.size() + 1, [&](size_t) {
+				g_sink = filter->in(input.data(), input.size())[0];
+			}) / input.size();
+		}
+		cout << endl;
+	}
+
+	cout << endl;
+	cout << "FilterBank<float> ns/frame of 256 channels" << endl;
+	cout << setw(12) << "node" << setw(12) << "objects" << setw(12) << "bank" << endl;
+	{
+		const size_t channels = 256, frames = samples / channels;
+		FilterBank<Limiter<float>> limiter(channels);
+		FilterBank<Comparator<float>> comparator(channels);
+		FilterBank<EMAFilter<float>> ema(channels);
+		FilterBank<HoldHigh<float>> high(channels, 64);
+		FilterBank<IIRFilter<float>> iir(channels, 2);
+		iir.setButterworthLowpass(0.05);
+		benchBank<Limiter<float>>("Limiter", limiter,
+			[] { return new Limiter<float>(); }, frames);
+		benchBank<Comparator<float>>("Comparator", comparator,
+			[] { return new Comparator<float>(); }, frames);
+		benchBank<EMAFilter<float>>("EMAFilter", ema,
+			[] { return new EMAFilter<float>(); }, frames);
+		benchBank<HoldHigh<float>>("HoldHigh", high,
+			[] { return new HoldHigh<float>(64); }, frames);
+		benchBank<IIRFilter<float>>("IIRFilter", iir, [] {
+			auto iir = new IIRFilter<float>(2);
+			iir->setButterworthLowpass(0.05);
+			return iir;
+		}, frames);
+	}
+
+	cout << endl;
+	cout << "Buffer -> Comparator -> Limiter ns/sample, dynamic against Pipeline" << endl;
+	cout << setw(12) << "path" << setw(12) << "dynamic" << setw(12) << "pipeline" << endl;
+	{
+		Buffer<float> input(64);
+		Comparator<float> comparator(0.f, &input);
+		Limiter<float> limiter(&comparator);
+		comparator.setThreshold(-1.f, 1.f);
+		limiter.setLimit(0.f, 0.5f);
+		Comparator<float> c;
+		Limiter<float> l;
+		c.setThreshold(-1.f, 1.f);
+		l.setLimit(0.f, 0.5f);
+		auto fused = Buffer<float>(64) | c | l;
+
+		double dynamic = nsPerSample(samples, [&](size_t i) {
+			input.in(float(i & 7) - 4.f);
+			g_sink = limiter.out();
+		});
+		double pipeline = nsPerSample(samples, [&](size_t i) {
+			g_sink = fused.in(float(i & 7) - 4.f);
+		});
+		cout << setw(12) << "sample" << fixed << setprecision(2)
+			<< setw(12) << dynamic << setw(12) << pipeline << endl;
+
+		std::vector<float> block(256);
+		for (size_t i = 0; i < block.size(); ++i)
+			block[i] = float(i & 7) - 4.f;
+		dynamic = nsPerSample(samples / block.size(), [&](size_t) {
+			input.in(block.data(), block.size());
+			g_sink = limiter.out();
+		}) / block.size();
+		pipeline = nsPerSample(samples / block.size(), [&](size_t) {
+			g_sink = fused.in(block.data(), block.size())[0];
+		}) / block.size();
+		cout << setw(12) << "block" << fixed << setprecision(2)
+			<< setw(12) << dynamic << setw(12) << pipeline << endl;
+	}
+
+	cout << endl;
+	cout << "64 nodes ns/sample, recursive in() against ExecutionPlan" << endl;
+	cout << setw(12) << "graph" << setw(12) << "recursive" << setw(12) << "plan" << endl;
+	for (bool deep : { true, false }) {
+		// a chain of limiters, or one buffer fanning out to limiters
+		Buffer<float> root(8);
+		std::vector<std::unique_ptr<Limiter<float>>> nodes;
+		for (size_t i = 0; i < 64; ++i) {
+			ProcessChain<float>* parent = (deep && i > 0) ?
+				static_cast<ProcessChain<float>*>(nodes.back().get()) : &root;
+			nodes.emplace_back(new Limiter<float>(parent));
+		}
+		ExecutionPlan<float> plan(&root);
+		double recursive = nsPerSample(samples / 16, [&](size_t i) {
+			g_sink = root.in(float(i & 7));
+		});
+		double flat = nsPerSample(samples / 16, [&](size_t i) {
+			g_sink = plan.in(float(i & 7));
+		});
+		cout << setw(12) << (deep ? "deep" : "wide") << fixed << setprecision(2)
+			<< setw(12) << recursive << setw(12) << flat << endl;
+	}
+
+	cout << endl;
+	WorkStealingPool pool;
+	cout << "32 MidAntiJitter branches ns/sample, serial against "
+		<< pool.workers() + 1 << " threads" << endl;
+	cout << setw(8) << "block" << setw(12) << "serial" << setw(12) << "parallel" << endl;
+	for (size_t n : { 16, 256, 4096 }) {
+		Buffer<float> serial(8), parallel(8);
+		std::vector<std::unique_ptr<MidAntiJitter<float>>> nodes;
+		for (size_t i = 0; i < 32; ++i) {
+			nodes.emplace_back(new MidAntiJitter<float>(255, &serial));
+			nodes.emplace_back(new MidAntiJitter<float>(255, &parallel));
+		}
+		ParallelExecutor<float> executor(&parallel, pool);
+		std::vector<float> block(n);
+		for (size_t i = 0; i < n; ++i)
+			block[i] = float((i * 7919) % 1009);
+		size_t blocks = samples / 64 / n + 1;
+		double one = nsPerSample(blocks, [&](size_t) {
+			g_sink = serial.in(block.data(), n)[0];
+		}) / n;
+		double many = nsPerSample(blocks, [&](size_t) {
+			g_sink = executor.in(block.data(), n)[0];
+		}) / n;
+		cout << setw(8) << n << fixed << setprecision(2)
+			<< setw(12) << one << setw(12) << many << endl;
+	}
+
+	cout << endl;
+	cout << "Ingest<float> ns/sample into a NuBuffer, lateness 64" << endl;
+	cout << setw(12) << "producers" << setw(12) << "ns" << endl;
+	for (size_t producers : { 1, 2, 4 }) {
+		Buffer<float> time(1024);
+		NuBuffer<float> values(1024, &time);
+		Ingest<float> ingest(&time, &values, 64.f);
+		const size_t count = samples / 4;
+		double ns = nsPerSample(1, [&](size_t) {
+			std::atomic<size_t> done(0);
+			std::vector<std::thread> threads;
+			for (size_t p = 0; p < producers; ++p) {
+				threads.emplace_back([&, p] {
+					for (size_t i = p; i < count; i += producers) {
+						while (!ingest.push(float(i), float(i & 255)))
+							std::this_thread::yield();
+					}
+					++done;
+				});
+			}
+			while (done < producers) {
+				if (ingest.poll() == 0)
+					std::this_thread::yield();
+			}
+			for (auto& thread : threads)
+				thread.join();
+			ingest.flush();
+		}) / count;
+		cout << setw(12) << producers << fixed << setprecision(2) << setw(12) << ns << endl;
+	}
+
+	cout << endl;
+	cout << "NuBuffer<float> ns/lookup, Linear" << endl;
+	cout << setw(8) << "window" << setw(12) << "atTime" << setw(12) << "batch"
+		<< setw(12) << "random" << setw(12) << "interp" << endl;
+	for (size_t size : { 64, 4096, 65536 }) {
+		Buffer<float> time(size);
+		NuBuffer<float> values(size, &time);
+		for (size_t i = 0; i < size; ++i) {
+			time.in(float(i) + float(i % 3) * 0.1f);
+			values.in(float(i & 255));
+		}
+		std::vector<float> times(size), out(size);
+		for (size_t i = 0; i < size; ++i)
+			times[i] = float(i) * 0.999f + 0.3f;
+		size_t rounds = samples / 16 / size + 1;
+		double single = nsPerSample(rounds, [&](size_t) {
+			for (size_t i = 0; i < size; ++i)
+				out[i] = values.atTime(times[i], Linear);
+			g_sink = out[0];
+		}) / size;
+		double batch = nsPerSample(rounds, [&](size_t) {
+			values.atTime(times.data(), out.data(), size, Linear);
+			g_sink = out[0];
+		}) / size;
+		auto sequential = values.cursor();
+		auto interpolated = values.cursor(Interpolated);
+		double random = nsPerSample(rounds, [&](size_t) {
+			for (size_t i = 0; i < size; ++i)
+				out[i] = sequential.atTime(times[(i * 7919) % size], Linear);
+			g_sink = out[0];
+		}) / size;
+		double interp = nsPerSample(rounds, [&](size_t) {
+			for (size_t i = 0; i < size; ++i)
+				out[i] = interpolated.atTime(times[(i * 7919) % size], Linear);
+			g_sink = out[0];
+		}) / size;
+		cout << setw(8) << size << fixed << setprecision(2) << setw(12) << single
+			<< setw(12) << batch << setw(12) << random << setw(12) << interp << endl;
+	}
+
+	cout << endl;
+	cout << "NuBuffer<float> ns/point onto a uniform grid, window 100000" << endl;
+	cout << setw(14) << "type" << setw(12) << "atTime" << setw(12) << "resample" << endl;
+	{
+		const size_t size = 100000;
+		Buffer<float> time(size);
+		NuBuffer<float> values(size, &time);
+		for (size_t i = 0; i < size; ++i) {
+			time.in(float(i) + float(i % 3) * 0.1f);
+			values.in(sinf(float(i) * 0.01f));
+		}
+		std::vector<float> times(size), out(size);
+		for (size_t i = 0; i < size; ++i)
+			times[i] = float(i) * 0.999f + 0.3f;
+		const char* names[] = { "Nearest", "Linear", "Spline", "NaturalSpline" };
+		for (auto type : { Nearest, Linear, Spline, NaturalSpline }) {
+			Resampler<float> resampler(type);
+			size_t rounds = samples / 16 / size + 1;
+			// a natural spline solve per point would take hours
+			double single = (type == NaturalSpline) ? 0. : nsPerSample(rounds, [&](size_t) {
+				values.atTime(times.data(), out.data(), size, type);
+				g_sink = out[0];
+			}) / size;
+			double bulk = nsPerSample(rounds, [&](size_t) {
+				resampler.resample(values, 0.3f, 0.999f, out.data(), size);
+				g_sink = out[0];
+			}) / size;
+			cout << setw(14) << names[type] << fixed << setprecision(2) << setw(12) << single
+				<< setw(12) << bulk << endl;
+		}
+	}
+
+	cout << endl;
+	cout << "Buffer<float> ns/sample in blocks of 256, heap against mapped file" << endl;
+	cout << setw(10) << "window" << setw(12) << "heap" << setw(12) << "mapped" << endl;
+	for (size_t size : { 4096, 1 << 18, 1 << 22 }) {
+		std::string path = "/tmp/bench_filter_" + std::to_string(getpid()) + ".buf";
+		Buffer<float> heap(size);
+		MappedBuffer<float> mapped(path, size);
+		std::vector<float> block(256);
+		for (size_t i = 0; i < block.size(); ++i)
+			block[i] = float(i);
+		size_t rounds = (samples + size) / block.size();
+		double inHeap = nsPerSample(rounds, [&](size_t) {
+			heap.in(block.data(), block.size());
+			g_sink = heap.front();
+		}) / block.size();
+		double inMapped = nsPerSample(rounds, [&](size_t) {
+			mapped.in(block.data(), block.size());
+			g_sink = mapped.front();
+		}) / block.size();
+		unlink(path.c_str());
+		cout << setw(10) << size << fixed << setprecision(2) << setw(12) << inHeap
+			<< setw(12) << inMapped << endl;
+	}
+
+	cout << endl;
+	cout << "Recorder/Replayer<float>, 1 kHz timestamps, 12 bit sensor values" << endl;
+	cout << setw(10) << "encoding" << setw(14) << "bytes/sample" << setw(14) << "record ns"
+		<< setw(16) << "replay Msps" << endl;
+	for (auto encoding : { RawValues, XorValues }) {
+		std::string path = "/tmp/bench_filter_" + std::to_string(getpid()) + ".rec";
+		const size_t count = samples, block = 1024;
+		std::vector<float> times(count), values(count);
+		for (size_t i = 0; i < count; ++i) {
+			times[i] = float(i % 100000) * 0.001f;
+			values[i] = float(int(2048.f + 1000.f * sinf(float(i) * 0.001f)) + int(i % 5)) / 4096.f;
+		}
+		Buffer<float> time(block);
+		Filter<float> input;
+		double record;
+		{
+			Recorder<float> recorder(path, &time, encoding, &input);
+			record = nsPerSample(count / block, [&](size_t i) {
+				time.in(times.data() + i * block, block);
+				input.in(values.data() + i * block, block);
+			}) / block;
+		}
+		Buffer<float> replayTime(block);
+		Filter<float> replayInput;
+		NuBuffer<float> replayValues(block, &replayTime, &replayInput);
+		Replayer<float> replayer(path);
+		replayer.replay(&replayTime, &replayInput, block);
+		g_sink = replayValues.front();
+		cout << setw(10) << (encoding == RawValues ? "raw" : "xor") << fixed << setprecision(2)
+			<< setw(14) << double(replayer.bytes()) / double(replayer.replayed())
+			<< setw(14) << record << setw(16) << replayer.samplesPerSecond() * 1e-6 << endl;
+		unlink(path.c_str());
+	}
+
+	cout << endl;
+	cout << "16 channels of MidAntiJitter/HoldHigh into NuBuffer<float>, heap vs one Arena" << endl;
+	cout << setw(10) << "window" << setw(12) << "heap ns" << setw(12) << "arena ns"
+		<< setw(12) << "huge ns" << setw(12) << "slab KiB" << endl;
+	for (size_t window : { 64, 1024, 8192 }) {
+		const size_t channels = 16, ticks = std::min(samples, size_t(20000));
+		double result[3];
+		size_t bytes = 0;
+		for (int mode = 0; mode < 3; ++mode) {
+			Arena arena(mode == 2);
+			// other allocations in between scatter the heap graph as a long
+			// running process would
+			std::vector<std::unique_ptr<ProcessChain<float>>> nodes;
+			std::vector<std::vector<char>> clutter;
+			Buffer<float> time(window);
+			Filter<float> input;
+			for (size_t c = 0; c < channels; ++c) {
+				ProcessChain<float>* filter = (c % 2 == 0) ?
+					static_cast<ProcessChain<float>*>(new MidAntiJitter<float>(window, &input)) :
+					static_cast<ProcessChain<float>*>(new HoldHigh<float>(window, &input));
+				nodes.emplace_back(filter);
+				clutter.emplace_back(4096 + 64 * c);
+				nodes.emplace_back(new NuBuffer<float>(window, &time, filter));
+				clutter.emplace_back(4096 + 64 * c);
+			}
+			if (mode > 0) {
+				arena.adopt<float>(&input);
+				bytes = arena.size();
+			}
+			result[mode] = nsPerSample(ticks, [&](size_t i) {
+				time.in(float(i));
+				input.in(float((i * 7919) % 1009));
+			});
+			g_sink = input.out();
+		}
+		cout << setw(10) << window << fixed << setprecision(2) << setw(12) << result[0]
+			<< setw(12) << result[1] << setw(12) << result[2]
+			<< setw(12) << bytes / 1024 << endl;
+	}
+
+	cout << endl;
+	cout << "Buffer<float> window sum, ring iterators vs view runs" << endl;
+	cout << setw(10) << "size" << setw(14) << "iterator ns" << setw(12) << "view ns" << endl;
+	for (size_t size : { 64, 4096, 65536 }) {
+		Buffer<float> buffer(size);
+		for (size_t i = 0; i < size + size / 3; ++i)
+			buffer.in(float(i % 100));
+		const size_t rounds = std::max(size_t(1), samples / size);
+		double iterated = nsPerSample(rounds, [&](size_t) {
+			float sum = 0;
+			for (auto it = buffer.cbegin(); it != buffer.cend(); ++it)
+				sum += *it;
+			g_sink = sum;
+		}) / size;
+		double viewed = nsPerSample(rounds, [&](size_t) {
+			RingView<const float> view = buffer.view();
+			float sum = 0;
+			for (float value : view.first)
+				sum += value;
+			for (float value : view.second)
+				sum += value;
+			g_sink = sum;
+		}) / size;
+		cout << setw(10) << size << fixed << setprecision(3) << setw(14) << iterated
+			<< setw(12) << viewed << endl;
+	}
+
+	cout << endl;
+	cout << "Buffer<float> vs StaticBuffer<float, N>, push + sample(2.5) ns" << endl;
+	cout << setw(10) << "N" << setw(12) << "Buffer" << setw(14) << "StaticBuffer"
+		<< setw(12) << "HoldHigh" << setw(14) << "HoldHigh<N>" << endl;
+	benchStatic<6>(samples);
+	benchStatic<16>(samples);
+	benchStatic<64>(samples);
+	benchStatic<1024>(samples);
+
+	cout << endl;
+	cout << "worst case in() latency per node, window 1024, ns per call" << endl;
+	cout << setw(22) << "node" << setw(10) << "p50" << setw(10) << "p99"
+		<< setw(10) << "p99.9" << setw(12) << "max" << endl;
+	{
+		const size_t calls = std::max(samples, size_t(10000));
+		std::vector<float> taps(1024, 1.f / 1024.f);
+		Buffer<float> time(1024);
+		Comparator<float> comparator;
+		Limiter<float> limiter;
+		EMAFilter<float> ema;
+		Buffer<float> buffer(1024);
+		StaticBuffer<float, 1024> fixed;
+		HoldHigh<float> high(1024);
+		HoldHigh<float, 1024> fixedHigh;
+		ScanHoldHigh<float> scanHigh(1024);
+		MidAntiJitter<float> median(1023);
+		MidAntiJitter<float> longMedian(RankFilter<float>::skiplistSize);
+		HistAntiJitter<float> hist(1024, 256, -512.f, 512.f);
+		FIRFilter<float> fir(64);
+		IIRFilter<float> iir(4);
+		ConvolutionFilter<float> direct(taps.data(), 64, 64, Direct);
+		ConvolutionFilter<float> partitioned(taps.data(), 1024, 64, Partitioned);
+		fir.setCoeff(taps.data());
+		iir.setButterworthLowpass(0.1);
+		benchLatency("Comparator", comparator, calls);
+		benchLatency("Limiter", limiter, calls);
+		benchLatency("EMAFilter", ema, calls);
+		benchLatency("Buffer", buffer, calls);
+		benchLatency("StaticBuffer", fixed, calls);
+		benchLatency("HoldHigh", high, calls);
+		benchLatency("HoldHigh<1024>", fixedHigh, calls);
+		benchLatency("ScanHoldHigh", scanHigh, calls);
+		benchLatency("MidAntiJitter", median, calls);
+		benchLatency("MidAntiJitter 16384", longMedian, calls);
+		benchLatency("HistAntiJitter", hist, calls);
+		benchLatency("FIRFilter 64", fir, calls);
+		benchLatency("IIRFilter 4", iir, calls);
+		benchLatency("Convolution direct", direct, calls);
+		benchLatency("Convolution 1024", partitioned, calls);
+	}
+
+	cout << endl;
+	cout << "bulk mix ns/value per kernel, 4096 values" << endl;
+	cout << setw(8) << "type" << setw(12) << "scalar" << setw(12) << "sse2"
+		<< setw(12) << "avx2" << setw(12) << "avx512" << endl;
+	benchMix<float>("float", 4096, samples * 4);
+	benchMix<double>("double", 4096, samples * 4);
+	benchMix<Q15>("Q15", 4096, samples * 4);
+	benchMix<Q31>("Q31", 4096, samples * 4);
+
+	cout << endl;
+	cout << "Buffer::sample Linear ns/value, 1024 indexes into 4096" << endl;
+	cout << setw(8) << "type" << setw(12) << "single" << setw(12) << "bulk" << endl;
+	{
+		Buffer<float> floats(4096);
+		Buffer<Q15> q15s(4096);
+		std::vector<float> index(1024), output(1024);
+		std::vector<Q15> q15Output(1024);
+		for (size_t i = 0; i < 4096; ++i) {
+			floats.in(sinf(float(i)));
+			q15s.in(Q15(sinf(float(i))));
+		}
+		for (size_t i = 0; i < index.size(); ++i)
+			index[i] = float((i * 7919) % 4093) + 0.37f;
+		const size_t calls = std::max(samples / index.size(), size_t(1));
+		double single = nsPerSample(calls, [&](size_t) {
+			for (size_t i = 0; i < index.size(); ++i)
+				output[i] = floats.sample(index[i]);
+			g_sink = output[7];
+		}) / double(index.size());
+		double bulk = nsPerSample(calls, [&](size_t) {
+			floats.sample(index.data(), output.data(), index.size());
+			g_sink = output[7];
+		}) / double(index.size());
+		cout << setw(8) << "float" << fixed << setprecision(2)
+			<< setw(12) << single << setw(12) << bulk << endl;
+		single = nsPerSample(calls, [&](size_t) {
+			for (size_t i = 0; i < index.size(); ++i)
+				q15Output[i] = q15s.sample(index[i]);
+			g_sink = float(double(q15Output[7]));
+		}) / double(index.size());
+		bulk = nsPerSample(calls, [&](size_t) {
+			q15s.sample(index.data(), q15Output.data(), index.size());
+			g_sink = float(double(q15Output[7]));
+		}) / double(index.size());
+		cout << setw(8) << "Q15" << setw(12) << single << setw(12) << bulk << endl;
+	}
+
+	cout << endl;
+	cout << "value types ns/sample" << endl;
+	cout << setw(8) << "type" << setw(12) << "EMA" << setw(12) << "FIR 64"
+		<< setw(12) << "median 63" << endl;
+	benchValueType<float>("float", samples);
+	benchValueType<double>("double", samples);
+	benchValueType<Q15>("Q15", samples);
+	benchValueType<Q31>("Q31", samples);
+
+	return 0;
+}
@@ -5,14 +5,37 @@
 #define ASSERT(statement) (void)((statement));
 #endif
 
+#include "fixed.h"
+#include "simd.h"
+
 #include <cmath>
-#include <deque>
+#include <cstdint>
+#include <limits>
+#include <atomic>
+#include <array>
 #include <vector>
+#include <iterator>
+#include <type_traits>
+#include <stdexcept>
 #include <memory>
 #include <ostream>
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define FILTERLIB_TSC
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define FILTERLIB_TSC
+#endif
 
 #ifdef min
 #undef min
@@ -41,7 +64,14 @@ enum SampleType
 {
 	Nearest = 0,
 	Linear,
-	Spline,
+	Spline, // Catmull-Rom
+	NaturalSpline, // natural cubic through every sample
+};
+
+enum SeekMode
+{
+	Sequential = 0,
+	Interpolated,
 };
 
 
@@ -54,6 +84,15 @@ struct Buffer_T {
 	static ValueType mix(ValueType a, ValueType b, fsize_t u) {
 		return (u < fsize_t(0.5)) ? a : b;
 	}
+	// output[i] = mix(a[i], b[i], u[i]) over whole arrays
+	static void mix(const ValueType* a, const ValueType* b, const fsize_t* u,
+		ValueType* output, size_t n) {
+		for (size_t i = 0; i < n; ++i)
+			output[i] = mix(a[i], b[i], u[i]);
+	}
+	// only reached for linear types
+	static fsize_t real(ValueType) { return 0; }
+	static ValueType value(fsize_t) { return ValueType(); }
 };
 
 template<typename ValueT>
@@ -69,6 +108,14 @@ struct Buffer_T<int> {
 	static ValueType mix(ValueType a, ValueType b, fsize_t u) {
 		return ValueType(std::round(a * (fsize_t(1.0) - u) + b * u));
 	}
+	// output[i] = mix(a[i], b[i], u[i]) over whole arrays
+	static void mix(const ValueType* a, const ValueType* b, const fsize_t* u,
+		ValueType* output, size_t n) {
+		for (size_t i = 0; i < n; ++i)
+			output[i] = mix(a[i], b[i], u[i]);
+	}
+	static fsize_t real(ValueType a) { return fsize_t(a); }
+	static ValueType value(fsize_t a) { return ValueType(std::round(a)); }
 };
 
 const Buffer_T<int>::ValueType Buffer_T<int>::zero =
@@ -83,20 +130,765 @@ struct Buffer_T<float> {
 	static ValueType mix(ValueType a, ValueType b, fsize_t u) {
 		return a * (fsize_t(1.0) - u) + b * u;
 	}
+	// through the widest kernel of the machine, same bits as the above
+	static void mix(const ValueType* a, const ValueType* b, const fsize_t* u,
+		ValueType* output, size_t n) {
+		static const simd::Kernel<ValueType>::Mix kernel = simd::Kernel<ValueType>::mix();
+		kernel(a, b, u, output, n);
+	}
+	static fsize_t real(ValueType a) { return a; }
+	static ValueType value(fsize_t a) { return a; }
 };
 
 const Buffer_T<float>::ValueType Buffer_T<float>::zero =
 	0;
 
+template<>
+struct Buffer_T<double> {
+	typedef double ValueType;
+	static const ValueType zero;
+	static constexpr bool linear = true;
+	static ValueType mix(ValueType a, ValueType b, fsize_t u) {
+		return a * (fsize_t(1.0) - u) + b * u;
+	}
+	// through the widest kernel of the machine, same bits as the above
+	static void mix(const ValueType* a, const ValueType* b, const fsize_t* u,
+		ValueType* output, size_t n) {
+		static const simd::Kernel<ValueType>::Mix kernel = simd::Kernel<ValueType>::mix();
+		kernel(a, b, u, output, n);
+	}
+	// splines interpolate in fsize_t
+	static fsize_t real(ValueType a) { return fsize_t(a); }
+	static ValueType value(fsize_t a) { return a; }
+};
+
+const Buffer_T<double>::ValueType Buffer_T<double>::zero =
+	0;
+
+// Q15, Q31 and other Fixed mix in their raw integers, rounded
+template<typename Raw, typename Wide, int Frac>
+struct Buffer_T<Fixed<Raw, Wide, Frac>> {
+	typedef Fixed<Raw, Wide, Frac> ValueType;
+	static const ValueType zero;
+	static constexpr bool linear = true;
+	static ValueType mix(ValueType a, ValueType b, fsize_t u) {
+		return ValueType::mix(a, b, u);
+	}
+	static void mix(const ValueType* a, const ValueType* b, const fsize_t* u,
+		ValueType* output, size_t n) {
+		static const typename simd::Kernel<ValueType>::Mix kernel =
+			simd::Kernel<ValueType>::mix();
+		kernel(a, b, u, output, n);
+	}
+	static fsize_t real(ValueType a) { return fsize_t(double(a)); }
+	static ValueType value(fsize_t a) { return ValueType(a); }
+};
+
+template<typename Raw, typename Wide, int Frac>
+const typename Buffer_T<Fixed<Raw, Wide, Frac>>::ValueType
+	Buffer_T<Fixed<Raw, Wide, Frac>>::zero = ValueType();
+
 
 static_assert(Buffer_T<fsize_t>::linear,
 	"fsize_t not interpolatable");
 static_assert(Buffer_T<time_t>::linear,
 	"time_t not interpolatable");
 
+// cubic from y1 to y2 over an interval of length h with end slopes d1 and
+// d2, at u in [0, 1]
+inline fsize_t hermite(fsize_t y1, fsize_t y2, fsize_t d1, fsize_t d2,
+	fsize_t h, fsize_t u) {
+	fsize_t c2 = 3 * (y2 - y1) - h * (2 * d1 + d2);
+	fsize_t c3 = 2 * (y1 - y2) + h * (d1 + d2);
+	return ((c3 * u + c2) * u + h * d1) * u + y1;
+}
+
+// Catmull-Rom slope at x1 from its neighbours, one sided at the ends
+inline fsize_t slope(fsize_t x0, fsize_t y0, fsize_t x2, fsize_t y2) {
+	return (x2 != x0) ? (y2 - y0) / (x2 - x0) : fsize_t(0);
+}
+
+// second derivatives m of the natural cubic spline through n knots with
+// ascending x, zero at both ends. scratch holds n values
+inline void naturalSpline(const fsize_t* x, const fsize_t* y, fsize_t* m,
+	size_t n, fsize_t* scratch) {
+	if (n < 3) {
+		std::fill(m, m + n, fsize_t(0));
+		return;
+	}
+	// Thomas algorithm on the tridiagonal system of the inner knots
+	m[0] = scratch[0] = 0;
+	for (size_t i = 1; i + 1 < n; ++i) {
+		fsize_t h0 = x[i] - x[i - 1], h1 = x[i + 1] - x[i];
+		fsize_t r0 = (h0 > 0) ? (y[i] - y[i - 1]) / h0 : 0;
+		fsize_t r1 = (h1 > 0) ? (y[i + 1] - y[i]) / h1 : 0;
+		fsize_t pivot = 2 * (h0 + h1) - h0 * scratch[i - 1];
+		pivot = (pivot != 0) ? pivot : 1;
+		scratch[i] = h1 / pivot;
+		m[i] = (6 * (r1 - r0) - h0 * m[i - 1]) / pivot;
+	}
+	m[n - 1] = 0;
+	for (size_t i = n - 1; i-- > 1;)
+		m[i] -= scratch[i] * m[i + 1];
+}
+
+// natural cubic from y1 to y2 over length h with second derivatives m1, m2
+inline fsize_t natural(fsize_t y1, fsize_t y2, fsize_t m1, fsize_t m2,
+	fsize_t h, fsize_t u) {
+	fsize_t v = 1 - u;
+	return v * y1 + u * y2 + ((v * v * v - v) * m1 + (u * u * u - u) * m2) * h * h / 6;
+}
+
+// knots and second derivatives of a natural spline. Callers that keep
+// one between solves stop allocating once it has grown
+struct SplineKnots {
+	std::vector<fsize_t> x, y, m, scratch;
+
+	inline void resize(size_t n) {
+		x.resize(n);
+		y.resize(n);
+		m.resize(n);
+		scratch.resize(n);
+	}
+
+	inline void solve() {
+		naturalSpline(x.data(), y.data(), m.data(), x.size(), scratch.data());
+	}
+
+	// segment k, from knot k to k + 1 over length h, at u in [0, 1]
+	inline fsize_t at(size_t k, fsize_t h, fsize_t u) const {
+		return natural(y[k], y[k + 1], m[k], m[k + 1], h, u);
+	}
+};
+
+
+// size and kind of T, guards files against being read as the wrong type.
+// Fixed point is signed and exact without being an integer
+template<typename T>
+inline uint32_t elementTag() {
+	typedef std::numeric_limits<T> limits;
+	return uint32_t(sizeof(T)) |
+		(uint32_t(std::is_floating_point<T>::value) << 16) |
+		(uint32_t(std::is_signed<T>::value || limits::is_signed) << 17) |
+		(uint32_t(limits::is_exact && !limits::is_integer) << 18);
+}
+
+// what a push changes besides the data, apart from it so storage that
+// outlives the buffer can keep it too
+struct RingState {
+	size_t head; // slot of the newest element
+	size_t pushed;
+	// seqlock: odd while the single writer changes the fields above
+	std::atomic<size_t> sequence;
+};
+
+// N values inline, the size fixed at compile time
+template<typename T, size_t N = 0>
+class Storage {
+public:
+	Storage() { }
+
+	Storage(size_t size, const T& value) {
+		ASSERT(size == N);
+		(void)(size);
+		m_data.fill(value);
+	}
+
+	static constexpr size_t size() { return N; }
+	static constexpr bool empty() { return N == 0; }
+	inline T* data() { return m_data.data(); }
+	inline const T* data() const { return m_data.data(); }
+	inline T& operator[](size_t i) { return m_data[i]; }
+	inline const T& operator[](size_t i) const { return m_data[i]; }
+	inline T* begin() { return m_data.data(); }
+	inline T* end() { return m_data.data() + N; }
+	inline const T* begin() const { return m_data.data(); }
+	inline const T* end() const { return m_data.data() + N; }
+	inline T& back() { return m_data[N - 1]; }
+	inline const T& back() const { return m_data[N - 1]; }
+
+	static constexpr bool owned() { return false; }
+
+private:
+	std::array<T, N> m_data;
+};
+
+// N = 0: a fixed size array on the heap, or on memory someone else owns
+// and frees such as a mapping or an Arena. relocate() moves it there
+template<typename T>
+class Storage<T, 0> {
+public:
+	Storage() :
+		m_data(nullptr),
+		m_size(0)
+	{
+
+	}
+
+	Storage(size_t size, const T& value) :
+		m_heap(size, value),
+		m_data(m_heap.data()),
+		m_size(size)
+	{
+
+	}
+
+	Storage(T* data, size_t size) :
+		m_data(data),
+		m_size(size)
+	{
+
+	}
+
+	// copies always go to the heap
+	Storage(const Storage& other) :
+		m_heap(other.begin(), other.end()),
+		m_data(m_heap.data()),
+		m_size(other.m_size)
+	{
+
+	}
+
+	// in place when the storage is elsewhere and big enough
+	Storage& operator=(const Storage& other) {
+		if (this == &other)
+			return *this;
+		if (!owned() && m_size == other.m_size) {
+			std::copy(other.begin(), other.end(), m_data);
+		} else {
+			m_heap.assign(other.begin(), other.end());
+			m_data = m_heap.data();
+			m_size = other.m_size;
+		}
+		return *this;
+	}
+
+	inline size_t size() const { return m_size; }
+	inline bool empty() const { return m_size == 0; }
+	inline T* data() { return m_data; }
+	inline const T* data() const { return m_data; }
+	inline T& operator[](size_t i) { return m_data[i]; }
+	inline const T& operator[](size_t i) const { return m_data[i]; }
+	inline T* begin() { return m_data; }
+	inline T* end() { return m_data + m_size; }
+	inline const T* begin() const { return m_data; }
+	inline const T* end() const { return m_data + m_size; }
+	inline T& back() { return m_data[m_size - 1]; }
+	inline const T& back() const { return m_data[m_size - 1]; }
+
+	inline bool owned() const { return m_data == m_heap.data() && m_size > 0; }
+
+	// copies the values to size() slots at to and frees the heap
+	inline void relocate(T* to) {
+		std::copy(begin(), end(), to);
+		m_data = to;
+		std::vector<T>().swap(m_heap);
+	}
+
+private:
+	std::vector<T> m_heap;
+	T* m_data;
+	size_t m_size;
+};
+
+template<typename T>
+class ProcessChain;
+
+// one slab for the arrays of a whole graph: rings, windows, trees and
+// kernels, each on its own cache lines in the order in() runs the nodes,
+// so a tick walks memory forward. Nodes hand their Storage over in
+// ProcessChain::relocate(). Everything is freed at once with the arena,
+// which therefore has to outlive the nodes it adopted. Huge pages are
+// asked for on Linux and quietly skipped when there are none
+class Arena {
+public:
+	static constexpr size_t alignment = 64;
+
+	explicit Arena(bool hugePages = false) :
+		m_slab(nullptr),
+		m_block(nullptr),
+		m_capacity(0),
+		m_used(0),
+		m_length(0),
+		m_measuring(false),
+		m_huge(hugePages),
+		m_mapped(false)
+	{
+
+	}
+
+	~Arena() { release(); }
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	// bytes in use and reserved
+	inline size_t size() const { return m_used; }
+	inline size_t capacity() const { return m_capacity; }
+	inline const void* data() const { return m_slab; }
+	// whether the slab got mapped for huge pages
+	inline bool hugePages() const { return m_mapped; }
+	inline bool contains(const void* p) const {
+		const char* c = static_cast<const char*>(p);
+		return m_slab != nullptr && c >= m_slab && c < m_slab + m_capacity;
+	}
+
+	// moves the arrays of root, its simblings and everything below them
+	// into one slab. Once per arena
+	template<typename T>
+	void adopt(ProcessChain<T>* root);
+
+	// one array, called from ProcessChain::relocate(). Storage that is not
+	// on the heap, empty or not trivially copyable stays where it is
+	template<typename T>
+	inline void place(Storage<T>& storage) {
+		if (!std::is_trivially_copyable<T>::value || !storage.owned())
+			return;
+		size_t bytes = (storage.size() * sizeof(T) + alignment - 1) & ~(alignment - 1);
+		if (m_measuring) {
+			m_used += bytes;
+			return;
+		}
+		ASSERT(m_used + bytes <= m_capacity);
+		storage.relocate(reinterpret_cast<T*>(m_slab + m_used));
+		m_used += bytes;
+	}
+
+	// inline storage moves with its node
+	template<typename T, size_t N>
+	inline void place(Storage<T, N>&) { }
+
+private:
+	char* m_slab;
+	void* m_block; // what got allocated, m_slab aligned within it
+	size_t m_capacity, m_used, m_length;
+	bool m_measuring, m_huge, m_mapped;
+
+	inline void allocate(size_t bytes) {
+		m_capacity = std::max(bytes, alignment);
+#ifdef __linux__
+		if (m_huge) {
+			const size_t page = size_t(2) << 20;
+			m_length = (m_capacity + page - 1) & ~(page - 1);
+			void* address = mmap(nullptr, m_length, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (address == MAP_FAILED) {
+				// no reserved huge pages, transparent ones then
+				address = mmap(nullptr, m_length, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (address != MAP_FAILED)
+					madvise(address, m_length, MADV_HUGEPAGE);
+			}
+			if (address != MAP_FAILED) {
+				m_block = address;
+				m_slab = static_cast<char*>(address);
+				m_mapped = true;
+				return;
+			}
+		}
+#endif
+		m_block = std::malloc(m_capacity + alignment);
+		if (m_block == nullptr)
+			throw std::bad_alloc();
+		uintptr_t address = reinterpret_cast<uintptr_t>(m_block);
+		m_slab = reinterpret_cast<char*>((address + alignment - 1) & ~uintptr_t(alignment - 1));
+	}
+
+	inline void release() {
+#ifdef __linux__
+		if (m_mapped) {
+			munmap(m_block, m_length);
+			m_block = nullptr;
+		}
+#endif
+		std::free(m_block);
+		m_block = nullptr;
+		m_slab = nullptr;
+	}
+};
+
+// contiguous run of values, not owning them
+template<typename T>
+struct Span {
+	T* data;
+	size_t size;
+
+	inline bool empty() const { return size == 0; }
+	inline T* begin() const { return data; }
+	inline T* end() const { return data + size; }
+	inline std::reverse_iterator<T*> rbegin() const { return std::reverse_iterator<T*>(end()); }
+	inline std::reverse_iterator<T*> rend() const { return std::reverse_iterator<T*>(begin()); }
+	inline T& operator[](size_t i) const { return data[i]; }
+};
+
+enum ViewOrder
+{
+	OldestFirst = 0,
+	NewestFirst,
+};
+
+// the newest values of a ring in place, as the one or two runs they
+// occupy in memory. OldestFirst reads first then second front to back,
+// NewestFirst reads first then second back to front. Valid until the
+// next push; from other threads take a snapshot() instead
+template<typename T>
+struct RingView {
+	Span<T> first, second;
+	ViewOrder order;
+
+	inline size_t size() const { return first.size + second.size; }
+	inline bool empty() const { return size() == 0; }
+
+	// index 0 is the oldest or the newest value, as ordered
+	inline T& operator[](size_t i) const {
+		if (order == NewestFirst) {
+			return (i < first.size) ?
+				first[first.size - 1 - i] :
+				second[second.size - 1 - (i - first.size)];
+		}
+		return (i < first.size) ? first[i] : second[i - first.size];
+	}
+
+	// size() values in the view's order
+	inline void copy(typename std::remove_const<T>::type* output) const {
+		if (order == NewestFirst) {
+			output = std::reverse_copy(first.begin(), first.end(), output);
+			std::reverse_copy(second.begin(), second.end(), output);
+		} else {
+			output = std::copy(first.begin(), first.end(), output);
+			std::copy(second.begin(), second.end(), output);
+		}
+	}
+};
+
+template<typename T>
+class RingBuffer {
+public:
+	typedef T value_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+
+	// random access over the logical order, index 0 is the newest element
+	template<typename R, typename V>
+	class Iterator {
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef typename std::remove_const<V>::type value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef V* pointer;
+		typedef V& reference;
+
+		Iterator() : m_ring(nullptr), m_index(0) { }
+		Iterator(R* ring, size_type index) : m_ring(ring), m_index(index) { }
+		template<typename R2, typename V2>
+		Iterator(const Iterator<R2, V2>& other) :
+			m_ring(other.m_ring), m_index(other.m_index) { }
+
+		inline reference operator*() const { return (*m_ring)[m_index]; }
+		inline pointer operator->() const { return &(*m_ring)[m_index]; }
+		inline reference operator[](difference_type n) const {
+			return (*m_ring)[m_index + n];
+		}
+
+		inline Iterator& operator++() { ++m_index; return *this; }
+		inline Iterator& operator--() { --m_index; return *this; }
+		inline Iterator operator++(int) { Iterator r(*this); ++m_index; return r; }
+		inline Iterator operator--(int) { Iterator r(*this); --m_index; return r; }
+		inline Iterator& operator+=(difference_type n) { m_index += n; return *this; }
+		inline Iterator& operator-=(difference_type n) { m_index -= n; return *this; }
+		inline Iterator operator+(difference_type n) const { return Iterator(m_ring, m_index + n); }
+		inline Iterator operator-(difference_type n) const { return Iterator(m_ring, m_index - n); }
+		friend inline Iterator operator+(difference_type n, const Iterator& it) { return it + n; }
+		inline difference_type operator-(const Iterator& other) const {
+			return difference_type(m_index) - difference_type(other.m_index);
+		}
+
+		inline bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+		inline bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+		inline bool operator<(const Iterator& other) const { return m_index < other.m_index; }
+		inline bool operator>(const Iterator& other) const { return m_index > other.m_index; }
+		inline bool operator<=(const Iterator& other) const { return m_index <= other.m_index; }
+		inline bool operator>=(const Iterator& other) const { return m_index >= other.m_index; }
+
+	private:
+		template<typename, typename> friend class Iterator;
+		R* m_ring;
+		size_type m_index;
+	};
+
+	typedef Iterator<RingBuffer, T> iterator;
+	typedef Iterator<const RingBuffer, const T> const_iterator;
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+	RingBuffer(size_t size, const T& value) :
+		m_data(size, value),
+		m_state(&m_local)
+	{
+		m_local.head = size - 1;
+		m_local.pushed = 0;
+		m_local.sequence = 0;
+	}
+
+	RingBuffer(const RingBuffer& other) :
+		m_data(other.m_data),
+		m_state(&m_local)
+	{
+		m_local.head = other.m_state->head;
+		m_local.pushed = other.m_state->pushed;
+		m_local.sequence = 0;
+	}
+
+	RingBuffer& operator=(const RingBuffer& other) {
+		write([&] {
+			ASSERT(m_data.owned() || m_data.size() == other.m_data.size());
+			m_data = other.m_data;
+			m_state->head = other.m_state->head;
+			m_state->pushed = other.m_state->pushed;
+		});
+		return *this;
+	}
+
+	inline size_type size() const { return m_data.size(); }
+	inline bool empty() const { return m_data.empty(); }
+
+	inline reference operator[](size_type i) { return m_data[position(i)]; }
+	inline const_reference operator[](size_type i) const { return m_data[position(i)]; }
+	inline reference at(size_type i) {
+		if (i >= size())
+			throw std::out_of_range("RingBuffer::at");
+		return m_data[position(i)];
+	}
+	inline const_reference at(size_type i) const {
+		if (i >= size())
+			throw std::out_of_range("RingBuffer::at");
+		return m_data[position(i)];
+	}
+
+	inline reference front() { return m_data[m_state->head]; }
+	inline const_reference front() const { return m_data[m_state->head]; }
+	inline reference back() { return m_data[position(size() - 1)]; }
+	inline const_reference back() const { return m_data[position(size() - 1)]; }
+
+	inline iterator begin() { return iterator(this, 0); }
+	inline iterator end() { return iterator(this, size()); }
+	inline const_iterator begin() const { return cbegin(); }
+	inline const_iterator end() const { return cend(); }
+	inline const_iterator cbegin() const { return const_iterator(this, 0); }
+	inline const_iterator cend() const { return const_iterator(this, size()); }
+	inline reverse_iterator rbegin() { return reverse_iterator(end()); }
+	inline reverse_iterator rend() { return reverse_iterator(begin()); }
+	inline const_reverse_iterator crbegin() const { return const_reverse_iterator(cend()); }
+	inline const_reverse_iterator crend() const { return const_reverse_iterator(cbegin()); }
+
+	// drops the oldest element
+	inline void push(const T& value) {
+		write([&] {
+			RingState& state = *m_state;
+			state.head = (state.head + 1 == m_data.size()) ? 0 : state.head + 1;
+			m_data[state.head] = value;
+			++state.pushed;
+		});
+	}
+
+	// values are in time order, the last one becomes the newest
+	inline void push(const T* values, size_t n) {
+		size_t size = m_data.size();
+		if (n == 0)
+			return;
+		// only the newest size values are kept, all n count as pushed so
+		// rings of different sizes stay paired by push number
+		const size_t pushed = n;
+		if (n > size) {
+			values += n - size;
+			n = size;
+		}
+		size_t start = (m_state->head + 1 == size) ? 0 : m_state->head + 1;
+		size_t first = std::min(n, size - start);
+		write([&] {
+			std::copy(values, values + first, m_data.data() + start);
+			std::copy(values + first, values + n, m_data.data());
+			size_t head = start + n - 1;
+			m_state->head = (head >= size) ? head - size : head;
+			m_state->pushed += pushed;
+		});
+	}
+
+	// number of values pushed so far, safe from any thread
+	inline size_t pushes() const {
+		const RingState& state = *m_state;
+		for (;;) {
+			size_t sequence = state.sequence.load(std::memory_order_acquire);
+			size_t pushed = state.pushed;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (!(sequence & 1) && state.sequence.load(std::memory_order_relaxed) == sequence)
+				return pushed;
+		}
+	}
+
+	// safe from any thread while one thread pushes: copies the n values up
+	// to push number last, newest first. False when a push tore the copy or
+	// the ring no longer holds them, the writer never waits for readers
+	inline bool tryRead(T* output, size_t n, size_t last) const {
+		const RingState& state = *m_state;
+		size_t sequence = state.sequence.load(std::memory_order_acquire);
+		if (sequence & 1)
+			return false;
+		size_t pushed = state.pushed, head = state.head, size = m_data.size();
+		if (last > pushed || pushed - last + n > size)
+			return false;
+		size_t slot = pushed - last;
+		slot = (head >= slot) ? head - slot : head + size - slot;
+		for (size_t i = 0; i < n; ++i) {
+			output[i] = m_data[slot];
+			slot = (slot == 0) ? size - 1 : slot - 1;
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return state.sequence.load(std::memory_order_relaxed) == sequence;
+	}
+
+	// the newest n values without copying them
+	inline RingView<const T> view(size_t n, ViewOrder order = OldestFirst) const {
+		n = std::min(n, size());
+		const T* data = m_data.data();
+		size_t head = m_state->head;
+		// the newer run ends at head, the older one at the end of memory
+		size_t newer = std::min(n, head + 1), older = n - newer;
+		Span<const T> front = { data + head + 1 - newer, newer };
+		Span<const T> back = { data + size() - older, older };
+		if (order == NewestFirst || older == 0)
+			return { front, back, order };
+		return { back, front, order };
+	}
+
+	inline RingView<const T> view(ViewOrder order = OldestFirst) const {
+		return view(size(), order);
+	}
+
+	// moves the ring into arena, see Arena::place()
+	inline void relocate(Arena& arena) {
+		write([&] { arena.place(m_data); });
+	}
+
+protected:
+	Storage<T> m_data; // oldest to newest in memory, wrapping at head
+	RingState* m_state;
+	RingState m_local;
+
+	// over storage owned by someone else, state holds where it left off
+	RingBuffer(T* data, size_t size, RingState* state) :
+		m_data(data, size),
+		m_state(state)
+	{
+		ASSERT(data != nullptr && state != nullptr);
+	}
+
+	template<typename Write>
+	inline void write(Write change) {
+		std::atomic<size_t>& sequence = m_state->sequence;
+		size_t current = sequence.load(std::memory_order_relaxed);
+		sequence.store(current + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		change();
+		sequence.store(current + 2, std::memory_order_release);
+	}
+
+	inline size_t position(size_t i) const {
+		size_t head = m_state->head;
+		return (head >= i) ? head - i : head + m_data.size() - i;
+	}
+};
+
+// bumped whenever a node is linked, compiled plans compare it to decide
+// whether to rebuild
+inline size_t& topologyRevision() {
+	static size_t revision = 0;
+	return revision;
+}
+
+// time stamp counter cycles on x86, steady_clock nanoseconds elsewhere
+inline uint64_t profileTicks() {
+#ifdef FILTERLIB_TSC
+	return __rdtsc();
+#else
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// what one node cost, collected only when FILTERLIB_PROFILE is defined.
+// A call is one process() or one processBlock(), ticks are per call
+struct NodeProfile {
+	static constexpr size_t buckets = 40;
+
+	uint64_t calls, samples, total, max;
+	uint64_t histogram[buckets]; // calls by bit length of their ticks
+
+	NodeProfile() :
+		calls(0),
+		samples(0),
+		total(0),
+		max(0),
+		histogram()
+	{
+
+	}
+
+	inline void add(uint64_t ticks, size_t n) {
+		++calls;
+		samples += n;
+		total += ticks;
+		max = std::max(max, ticks);
+#if defined(__GNUC__)
+		size_t bucket = (ticks > 0) ? size_t(64 - __builtin_clzll(ticks)) : 0;
+#else
+		size_t bucket = 0;
+		for (uint64_t rest = ticks; rest > 0; rest >>= 1)
+			++bucket;
+#endif
+		++histogram[std::min(bucket, buckets - 1)];
+	}
+
+	// upper bound in ticks under which the fraction q of calls fell
+	inline uint64_t percentile(double q) const {
+		uint64_t rank = uint64_t(q * double(calls)), seen = 0;
+		for (size_t i = 0; i < buckets; ++i) {
+			seen += histogram[i];
+			if (seen > rank || seen == calls)
+				return (i == 0) ? 0 : (uint64_t(1) << i) - 1;
+		}
+		return max;
+	}
+};
+
+// scratch of at least n values for a hot path, returns its data. With
+// FILTERLIB_REALTIME growing it throws instead of allocating: make room
+// up front, see ProcessChain::prepare()
+template<typename V>
+inline typename V::value_type* scratch(V& vector, size_t n) {
+	if (vector.size() < n) {
+#ifdef FILTERLIB_REALTIME
+		throw std::length_error("FilterLib: block larger than prepared");
+#else
+		vector.resize(n);
+#endif
+	}
+	return vector.data();
+}
+
+template<typename T>
+class ExecutionPlan;
+template<typename T>
+class ParallelExecutor;
 
 template<typename T>
 class ProcessChain {
+	friend class ExecutionPlan<T>;
+	friend class ParallelExecutor<T>;
+	friend class Arena;
+
 public:
 	ProcessChain(ProcessChain* parent = nullptr) :
 		m_index(0),
@@ -107,6 +899,23 @@ public:
 		setParent(parent);
 	}
 
+	// a copy starts unlinked, the links belong to the graph of the original
+	ProcessChain(const ProcessChain& other) :
+		m_index(0),
+		m_parent(nullptr),
+		m_child(nullptr),
+		m_simbling(nullptr),
+		m_block(other.m_block)
+	{
+
+	}
+
+	// keeps its own place in the graph
+	ProcessChain& operator=(const ProcessChain& other) {
+		m_block = other.m_block;
+		return *this;
+	}
+
 	virtual ~ProcessChain() { }
 
 	inline ProcessChain& operator<<(const T& input) {
@@ -133,6 +942,7 @@ public:
 				0 :
 				m_simbling->m_index + 1;
 			parent->m_child = this;
+			++topologyRevision();
 		}
 	}
 
@@ -141,23 +951,152 @@ public:
 	inline size_t index() const { return m_index; }
 
 	virtual inline T in(const T& input) {
-		T output = process(input);
+		T output = run(input);
 		if (m_simbling != nullptr)
 			m_simbling->in(input);
 		if (m_child != nullptr)
 			m_child->in(output);
+		commit(output);
+		return output;
+	}
+
+	// same as feeding input[0..n) one by one, but every node handles the
+	// whole block before its simblings and children, returned block is
+	// valid until the next call
+	inline const T* in(const T* input, size_t n) {
+		const T* output = runBlock(input, n);
+		if (m_simbling != nullptr)
+			m_simbling->in(input, n);
+		if (m_child != nullptr)
+			m_child->in(output, n);
+		if (n > 0)
+			commit(output[n - 1]);
 		return output;
 	}
 
 	virtual T out() const = 0;
 
+	// room for blocks of up to n samples in this node, its simblings and
+	// everything below them, after which no in() allocates. Required
+	// before the first block when built with FILTERLIB_REALTIME
+	inline void prepare(size_t n) {
+		std::vector<ProcessChain*> stack(1, this);
+		while (!stack.empty()) {
+			ProcessChain* node = stack.back();
+			stack.pop_back();
+			node->reserve(n);
+			if (node->m_child != nullptr)
+				stack.push_back(node->m_child);
+			if (node->m_simbling != nullptr)
+				stack.push_back(node->m_simbling);
+		}
+	}
+
+	// the same for this node alone, nodes with scratch of their own add it
+	virtual void reserve(size_t n) {
+		if (m_block.size() < n)
+			m_block.resize(n);
+	}
+
+	// all zero unless built with FILTERLIB_PROFILE
+	inline const NodeProfile& profile() const {
+#ifdef FILTERLIB_PROFILE
+		return m_profile;
+#else
+		static const NodeProfile none;
+		return none;
+#endif
+	}
+
+	inline void resetProfile() {
+#ifdef FILTERLIB_PROFILE
+		m_profile = NodeProfile();
+#endif
+	}
+
 protected:
 	size_t m_index;
 	ProcessChain *m_parent, *m_child, *m_simbling;
+	std::vector<T> m_block;
+#ifdef FILTERLIB_PROFILE
+	NodeProfile m_profile;
+#endif
+
+	// process() and processBlock() as every driver calls them, timed when
+	// profiling
+	inline T run(const T& input) {
+#ifdef FILTERLIB_PROFILE
+		uint64_t start = profileTicks();
+		T output = process(input);
+		m_profile.add(profileTicks() - start, 1);
+		return output;
+#else
+		return process(input);
+#endif
+	}
+
+	inline const T* runBlock(const T* input, size_t n) {
+#ifdef FILTERLIB_PROFILE
+		uint64_t start = profileTicks();
+		const T* output = processBlock(input, n);
+		m_profile.add(profileTicks() - start, n);
+		return output;
+#else
+		return processBlock(input, n);
+#endif
+	}
 
 	virtual T process(const T& input) = 0;
+
+	virtual const T* processBlock(const T* input, size_t n) {
+		T* output = block(n);
+		for (size_t i = 0; i < n; ++i)
+			output[i] = process(input[i]);
+		return output;
+	}
+
+	// called with the last output once a sample or block went through
+	virtual void commit(const T& output) {
+		(void)(output);
+	}
+
+	// hands the node's arrays to Arena::place(), twice: once to measure,
+	// once to move them
+	virtual void relocate(Arena& arena) {
+		(void)(arena);
+	}
+
+	inline T* block(size_t n) {
+		return scratch(m_block, n);
+	}
 };
 
+// the nodes in the order in() runs them: each node, its simblings, then
+// its children
+template<typename T>
+void Arena::adopt(ProcessChain<T>* root) {
+	ASSERT(m_slab == nullptr);
+	std::vector<ProcessChain<T>*> order, stack(1, root);
+	while (!stack.empty()) {
+		ProcessChain<T>* node = stack.back();
+		stack.pop_back();
+		order.push_back(node);
+		if (node->first() != nullptr)
+			stack.push_back(node->first());
+		if (node->next() != nullptr)
+			stack.push_back(node->next());
+	}
+	m_measuring = true;
+	m_used = 0;
+	for (ProcessChain<T>* node : order)
+		node->relocate(*this);
+	m_measuring = false;
+	allocate(m_used);
+	m_used = 0;
+	for (ProcessChain<T>* node : order)
+		node->relocate(*this);
+}
+
 template<typename T>
 std::ostream& operator<<(std::ostream& a, const ProcessChain<T>& b) {
 	return a << b.out();
@@ -168,6 +1107,34 @@ inline T operator>>(const T& a, ProcessChain<T>& b) {
 	return b.in(a);
 }
 
+// ticks spent in root, its simblings and everything below them
+template<typename T>
+uint64_t profileTotal(const ProcessChain<T>* root) {
+	uint64_t total = 0;
+	std::vector<const ProcessChain<T>*> stack(1, root);
+	while (!stack.empty()) {
+		const ProcessChain<T>* node = stack.back();
+		stack.pop_back();
+		total += node->profile().total;
+		if (node->next() != nullptr)
+			stack.push_back(node->next());
+		if (node->first() != nullptr)
+			stack.push_back(node->first());
+	}
+	return total;
+}
+
+// " (12.5%)" of total for trace(), empty without profiling data
+template<typename T>
+std::string profileShare(const ProcessChain<T>* node, uint64_t total) {
+	if (total == 0)
+		return std::string();
+	std::stringstream ss;
+	ss << " (" << std::fixed << std::setprecision(1)
+		<< 100. * double(node->profile().total) / double(total) << "%)";
+	return ss.str();
+}
+
 template<typename T>
 class AbstractBuffer {
 public:
@@ -200,30 +1167,37 @@ template<typename T>
 class Buffer :
 	public ProcessChain<T>,
 	public AbstractBuffer<T>,
-	public std::deque<T>
+	public RingBuffer<T>
 {
 public:
 	Buffer(size_t size, ProcessChain<T>* parent = nullptr) :
 		ProcessChain<T>(parent),
 		AbstractBuffer<T>(),
-		std::deque<T>(size, Buffer<T>::trait::zero)
+		RingBuffer<T>(size, Buffer<T>::trait::zero)
 	{
 		ASSERT(size > 1);
 	}
 
 	virtual ~Buffer() { }
 
+	using ProcessChain<T>::in;
+
 	virtual inline std::string name() const { return m_name.empty() ? "Buffer" : m_name; }
 	inline void setName(const std::string name) { m_name = name; }
 
+	// rings over a mapping stay there
+	void relocate(Arena& arena) override {
+		RingBuffer<T>::relocate(arena);
+	}
+
 	inline T out() const override {
-		return std::deque<T>::front();
+		return RingBuffer<T>::front();
 	}
 
 	inline T sample(fsize_t index, SampleType type = Linear) const override {
 		index = std::max(index, static_cast<fsize_t>(0));
-		index = std::min(index, static_cast<fsize_t>(std::deque<T>::size() - 1));
-		T result;
+		index = std::min(index, static_cast<fsize_t>(RingBuffer<T>::size() - 1));
+		T result = Buffer::trait::zero;
 
 		if (!Buffer::trait::linear)
 			type = Nearest;
@@ -234,33 +1208,96 @@ public:
 		{
 			size_t i0 = static_cast<size_t>(index), i1 = i0 + 1;
 			fsize_t ir = index - i0;
-			i1 = std::min(i1, std::deque<T>::size() - 1);
+			i1 = std::min(i1, RingBuffer<T>::size() - 1);
 			result = (ir < fsize_t(0.5)) ?
-				std::deque<T>::at(i0) :
-				std::deque<T>::at(i1);
+				(*this)[i0] :
+				(*this)[i1];
 			break;
 		}
 		case Linear:
-		case Spline:
 		{
 			size_t i0 = static_cast<size_t>(index), i1 = i0 + 1;
 			fsize_t ir = index - i0;
-			i1 = std::min(i1, std::deque<T>::size() - 1);
-			result = Buffer::trait::mix(std::deque<T>::at(i0),
-				std::deque<T>::at(i1),
+			i1 = std::min(i1, RingBuffer<T>::size() - 1);
+			result = Buffer::trait::mix((*this)[i0],
+				(*this)[i1],
 				ir);
 			break;
 		}
+		case Spline:
+		{
+			size_t last = RingBuffer<T>::size() - 1;
+			size_t i0 = static_cast<size_t>(index), i1 = std::min(i0 + 1, last);
+			size_t im = (i0 > 0) ? i0 - 1 : 0, ip = std::min(i1 + 1, last);
+			fsize_t y0 = real(i0), y1 = real(i1);
+			fsize_t d0 = slope(fsize_t(im), real(im), fsize_t(i1), y1);
+			fsize_t d1 = slope(fsize_t(i0), y0, fsize_t(ip), real(ip));
+			result = Buffer::trait::value(hermite(y0, y1, d0, d1, 1, index - i0));
+			break;
+		}
+		case NaturalSpline:
+		{
+			// solved over the whole buffer on every call, O(size())
+			SplineKnots knots;
+			solveIndexSpline(knots);
+			result = indexSpline(knots, index);
+			break;
+		}
 		}
 
 		return result;
 	}
 
+	// output[i] = sample(index[i], type). Linear gathers the neighbours of
+	// a chunk of indexes and mixes them in one pass of the trait's kernel
+	inline void sample(const fsize_t* index, T* output, size_t n,
+		SampleType type = Linear) const {
+		if (!Buffer::trait::linear)
+			type = Nearest;
+		if (type == NaturalSpline) {
+			// one solve for all of them
+			SplineKnots knots;
+			sample(index, output, n, knots);
+			return;
+		}
+		if (type != Linear) {
+			for (size_t i = 0; i < n; ++i)
+				output[i] = sample(index[i], type);
+			return;
+		}
+		const size_t chunk = 64, last = RingBuffer<T>::size() - 1;
+		T a[chunk], b[chunk];
+		fsize_t u[chunk];
+		for (size_t start = 0; start < n; start += chunk) {
+			const size_t m = std::min(chunk, n - start);
+			for (size_t k = 0; k < m; ++k) {
+				fsize_t x = clamp(index[start + k], fsize_t(0), fsize_t(last));
+				size_t i0 = static_cast<size_t>(x);
+				a[k] = (*this)[i0];
+				b[k] = (*this)[std::min(i0 + 1, last)];
+				u[k] = x - fsize_t(i0);
+			}
+			Buffer::trait::mix(a, b, u, output + start, m);
+		}
+	}
+
+	// NaturalSpline over a batch with the caller's knots, no allocation
+	// once they have grown to size()
+	inline void sample(const fsize_t* index, T* output, size_t n,
+		SplineKnots& knots) const {
+		if (!Buffer::trait::linear) {
+			sample(index, output, n, Nearest);
+			return;
+		}
+		solveIndexSpline(knots);
+		const fsize_t last = static_cast<fsize_t>(RingBuffer<T>::size() - 1);
+		for (size_t i = 0; i < n; ++i)
+			output[i] = indexSpline(knots, clamp(index[i], fsize_t(0), last));
+	}
+
 	inline void to(std::vector<T>& vector) const override {
-		vector.reserve(std::deque<T>::size());
-		std::copy(std::deque<T>::cbegin(),
-			std::deque<T>::cend(),
-			vector.begin());
+		vector.resize(RingBuffer<T>::size());
+		this->view(NewestFirst).copy(vector.data());
 	}
 
 	inline T in(const T& input) override {
@@ -268,17 +1305,154 @@ public:
 	}
 
 	inline void fill(const T& value) override {
-		std::fill(std::deque<T>::begin(),
-			std::deque<T>::end(),
-			value);
+		this->write([&] {
+			std::fill(this->m_data.begin(), this->m_data.end(), value);
+		});
+	}
+
+	// consistent copy of the newest n values, newest first, safe from any
+	// thread while the pipeline pushes. Returns the push number of
+	// vector[0]
+	inline size_t snapshot(std::vector<T>& vector, size_t n) const {
+		n = std::min(n, RingBuffer<T>::size());
+		vector.resize(n);
+		for (;;) {
+			size_t last = this->pushes();
+			if (this->tryRead(vector.data(), n, last))
+				return last;
+		}
 	}
 
 protected:
 	std::string m_name;
 
+	// over storage owned by a derived class, see RingBuffer
+	Buffer(T* data, size_t size, RingState* state, ProcessChain<T>* parent) :
+		ProcessChain<T>(parent),
+		AbstractBuffer<T>(),
+		RingBuffer<T>(data, size, state)
+	{
+		ASSERT(size > 1);
+	}
+
+	inline fsize_t real(size_t i) const {
+		return Buffer::trait::real((*this)[i]);
+	}
+
+	// natural spline over the index, newest first
+	inline void solveIndexSpline(SplineKnots& knots) const {
+		const size_t n = RingBuffer<T>::size();
+		knots.resize(n);
+		for (size_t i = 0; i < n; ++i) {
+			knots.x[i] = fsize_t(i);
+			knots.y[i] = real(i);
+		}
+		knots.solve();
+	}
+
+	// index clamped to [0, size() - 1] already
+	inline T indexSpline(const SplineKnots& knots, fsize_t index) const {
+		size_t i0 = std::min(static_cast<size_t>(index), RingBuffer<T>::size() - 2);
+		return Buffer::trait::value(knots.at(i0, 1, index - fsize_t(i0)));
+	}
+
+	inline T process(const T& input) override {
+		RingBuffer<T>::push(input);
+		return input;
+	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		RingBuffer<T>::push(input, n);
+		return input;
+	}
+};
+
+// ring and state of a StaticBuffer, a base so both exist before Buffer
+template<typename T, size_t N>
+struct StaticRing {
+	std::array<T, N> ring;
+	RingState state;
+};
+
+// Buffer of N values with the ring inline, no heap involved. Power of two
+// sizes index with a mask. Goes anywhere a Buffer<T> does, e.g. as the
+// time reference of a NuBuffer, calls through Buffer<T> take its generic
+// path over the same ring
+template<typename T, size_t N>
+class StaticBuffer :
+	private StaticRing<T, N>,
+	public Buffer<T>
+{
+public:
+	static_assert(N > 1, "StaticBuffer needs at least two values");
+
+	static constexpr size_t capacity = N;
+	static constexpr bool masked = (N & (N - 1)) == 0;
+
+	explicit StaticBuffer(ProcessChain<T>* parent = nullptr) :
+		StaticRing<T, N>(),
+		Buffer<T>(this->ring.data(), N, &this->state, parent)
+	{
+		this->ring.fill(Buffer<T>::trait::zero);
+		this->state.head = N - 1;
+		this->state.pushed = 0;
+		this->state.sequence.store(0, std::memory_order_relaxed);
+	}
+
+	StaticBuffer(const StaticBuffer&) = delete;
+	StaticBuffer& operator=(const StaticBuffer&) = delete;
+
+	static constexpr size_t size() { return N; }
+
+	inline T& operator[](size_t i) { return this->ring[slot(i)]; }
+	inline const T& operator[](size_t i) const { return this->ring[slot(i)]; }
+	inline T& front() { return this->ring[this->state.head]; }
+	inline const T& front() const { return this->ring[this->state.head]; }
+	inline T& back() { return this->ring[slot(N - 1)]; }
+	inline const T& back() const { return this->ring[slot(N - 1)]; }
+
+	inline T out() const override { return front(); }
+
+	using Buffer<T>::sample;
+
+	// Nearest and Linear without a branch on the index, the splines as in
+	// Buffer
+	inline T sample(fsize_t index, SampleType type = Linear) const override {
+		if (!Buffer<T>::trait::linear)
+			type = Nearest;
+		if (type != Nearest && type != Linear)
+			return Buffer<T>::sample(index, type);
+		index = clamp(index, fsize_t(0), fsize_t(N - 1));
+		size_t i0 = static_cast<size_t>(index);
+		size_t i1 = i0 + size_t(i0 + 1 < N);
+		fsize_t ir = index - fsize_t(i0);
+		const T& a = (*this)[i0];
+		const T& b = (*this)[i1];
+		if (type == Nearest)
+			return (ir < fsize_t(0.5)) ? a : b;
+		return Buffer<T>::trait::mix(a, b, ir);
+	}
+
+	virtual inline std::string name() const override {
+		return this->m_name.empty() ? "StaticBuffer" : this->m_name;
+	}
+
+protected:
+	inline size_t slot(size_t i) const {
+		size_t head = this->state.head;
+		if (masked)
+			return (head - i) & (N - 1);
+		return (head >= i) ? head - i : head + N - i;
+	}
+
 	inline T process(const T& input) override {
-		std::deque<T>::pop_back();
-		std::deque<T>::emplace_front(input);
+		this->write([&] {
+			RingState& state = this->state;
+			state.head = masked ? (state.head + 1) & (N - 1) :
+				(state.head + 1 == N) ? 0 : state.head + 1;
+			this->ring[state.head] = input;
+			++state.pushed;
+		});
 		return input;
 	}
 };
@@ -297,13 +1471,14 @@ std::ostream& operator<<(std::ostream& a, const Buffer<T>& b) {
 }
 
 template<typename T>
-std::string trace(const Buffer<T>& head) {
+std::string trace(const Buffer<T>& head, bool costs = false) {
 	struct _buf_info {
 		Buffer<T>* buffer;
 		size_t prev, type, endpos;
 	};
 
 	std::stringstream ss;
+	uint64_t total = costs ? profileTotal<T>(&head) : 0;
 	std::string header, s;
 	std::vector<size_t> stack;
 	std::vector<_buf_info> list;
@@ -322,15 +1497,15 @@ std::string trace(const Buffer<T>& head) {
 		switch (buf.type & 0x0f) {
 		case 0:
 		{
-			ss << curr->name() << "[" << curr->size() << "]";
+			ss << curr->name() << "[" << curr->size() << "]" << profileShare<T>(curr, total);
 			break;
 		}
 		case 1:
 		{
 			if ((buf.type & 0xf0) > 0)
-				ss << " ->...-> " << curr->name() << "[" << curr->size() << "]";
+				ss << " ->...-> " << curr->name() << "[" << curr->size() << "]" << profileShare<T>(curr, total);
 			else
-				ss << " -> " << curr->name() << "[" << curr->size() << "]";
+				ss << " -> " << curr->name() << "[" << curr->size() << "]" << profileShare<T>(curr, total);
 			break;
 		}
 		case 2:
@@ -344,7 +1519,7 @@ std::string trace(const Buffer<T>& head) {
 				ss << '|';
 			ss << std::string(endpos - list[buf.prev].endpos, '-');
 			endpos = 0;
-			ss << "--> " << curr->name() << "[" << curr->size() << "]";
+			ss << "--> " << curr->name() << "[" << curr->size() << "]" << profileShare<T>(curr, total);
 			break;
 		}
 		}
@@ -404,6 +1579,23 @@ std::string trace(const Buffer<T>& head) {
 	return s;
 }
 
+// the two rings of a NuBuffer side by side, their runs split at
+// different places
+template<typename T>
+struct PairView {
+	RingView<const time_t> times;
+	RingView<const T> values;
+
+	inline size_t size() const { return values.size(); }
+	inline time_t time(size_t i) const { return times[i]; }
+	inline const T& value(size_t i) const { return values[i]; }
+
+	inline void copy(time_t* timeOutput, T* valueOutput) const {
+		times.copy(timeOutput);
+		values.copy(valueOutput);
+	}
+};
+
 template<typename T>
 class NuBuffer :
 	public Buffer<T>
@@ -438,32 +1630,227 @@ public:
 		return m_timeRef->front() - m_timeRef->back();
 	}
 
+	// remembers where the last lookup landed, so lookups at increasing
+	// (or decreasing) times only walk the few entries in between. With
+	// Interpolated every lookup starts from where time would sit if the
+	// timestamps were evenly spaced instead. Pushes to the time reference
+	// between lookups are accounted for
+	class Cursor {
+	public:
+		Cursor(const NuBuffer* buffer, SeekMode mode = Sequential) :
+			m_buffer(buffer),
+			m_mode(mode),
+			m_index(0),
+			m_pushes(0)
+		{
+			ASSERT(buffer != nullptr);
+		}
+
+		inline SeekMode mode() const { return m_mode; }
+
+		inline fsize_t seek(time_t time, SampleType type = Nearest) {
+			return m_buffer->position(find(time), time, type);
+		}
+
+		inline T atTime(time_t time, SampleType type = Nearest) {
+			return m_buffer->interpolate(find(time), time, type);
+		}
+
+	protected:
+		friend class NuBuffer;
+
+		const NuBuffer* m_buffer;
+		SeekMode m_mode;
+		size_t m_index, m_pushes;
+
+		inline size_t find(time_t time) {
+			size_t start = m_index;
+			size_t pushes = m_buffer->m_timeRef->pushes();
+			if (m_mode == Interpolated || m_index == 0)
+				start = m_buffer->guess(time);
+			else
+				start += pushes - m_pushes;
+			m_index = m_buffer->bracket(time, start);
+			m_pushes = pushes;
+			return m_index;
+		}
+	};
+
+	inline Cursor cursor(SeekMode mode = Sequential) const {
+		return Cursor(this, mode);
+	}
+
 	inline fsize_t seek(time_t time, SampleType type = Nearest) const {
 		ASSERT(m_timeRef != nullptr);
-		size_t l = 0, r = m_timeRef->size() - 1, m = l;
-		while (l + 1 < r) {
-			m = (l + r) >> 1;
-			if (m_timeRef->at(m) < time)
-				r = m;
+		return position(bisect(time, 0, m_timeRef->size() - 1), time, type);
+	}
+
+	// Spline and NaturalSpline interpolate in time rather than in index,
+	// NaturalSpline solves over the whole buffer on every call: batch the
+	// points below or use a Resampler for many of them
+	inline T atTime(time_t time, SampleType type = Nearest) const {
+		ASSERT(m_timeRef != nullptr);
+		return interpolate(bisect(time, 0, m_timeRef->size() - 1), time, type);
+	}
+
+	// one sweep for the whole batch when times are sorted, any order works.
+	// NaturalSpline is solved once for the batch
+	inline void atTime(const time_t* times, T* output, size_t n,
+		SampleType type = Nearest) const {
+		ASSERT(m_timeRef != nullptr);
+		if (type == NaturalSpline && Buffer<T>::trait::linear) {
+			SplineKnots knots;
+			atTime(times, output, n, knots);
+			return;
+		}
+		Cursor cursor(this);
+		for (size_t i = 0; i < n; ++i)
+			output[i] = cursor.atTime(times[i], type);
+	}
+
+	// NaturalSpline over a batch with the caller's knots, no allocation
+	// once they have grown to size()
+	inline void atTime(const time_t* times, T* output, size_t n,
+		SplineKnots& knots) const {
+		ASSERT(m_timeRef != nullptr);
+		if (!Buffer<T>::trait::linear) {
+			atTime(times, output, n, Nearest);
+			return;
+		}
+		Cursor cursor(this);
+		solveTimeSpline(knots);
+		for (size_t i = 0; i < n; ++i)
+			output[i] = timeSpline(knots, cursor.find(times[i]), times[i]);
+	}
+
+	inline void to(std::vector<TimeValuePair<T>>& vector) const {
+		PairView<T> view = pairs(NewestFirst);
+		vector.resize(view.size());
+		for (size_t i = 0; i < view.size(); ++i)
+			vector[i] = TimeValuePair<T>(view.time(i), view.value(i));
+	}
+
+	// times and values of the newest n samples in place, paired by index
+	// as in to()
+	inline PairView<T> pairs(size_t n, ViewOrder order = OldestFirst) const {
+		ASSERT(m_timeRef != nullptr);
+		n = std::min(n, RingBuffer<T>::size());
+		return { m_timeRef->view(n, order), this->view(n, order) };
+	}
+
+	inline PairView<T> pairs(ViewOrder order = OldestFirst) const {
+		return pairs(RingBuffer<T>::size(), order);
+	}
+
+	// consistent copy of the newest n (time, value) pairs, newest first,
+	// safe from any thread while the pipeline pushes. Values are paired
+	// with times by push count, not by index, so a reader between the
+	// time and the value push of one sample still gets matching pairs
+	inline size_t snapshot(std::vector<TimeValuePair<T>>& vector, size_t n) const {
+		ASSERT(m_timeRef != nullptr);
+		n = std::min(n, RingBuffer<T>::size());
+		std::vector<T> values(n);
+		std::vector<time_t> times(n);
+		for (;;) {
+			size_t last = std::min(this->pushes(), m_timeRef->pushes() - m_timeOffset);
+			if (this->tryRead(values.data(), n, last) &&
+				m_timeRef->tryRead(times.data(), n, last + m_timeOffset)) {
+				vector.resize(n);
+				for (size_t i = 0; i < n; ++i)
+					vector[i] = TimeValuePair<T>(times[i], values[i]);
+				return last;
+			}
+		}
+	}
+
+	inline Buffer<time_t>* timeRef() const { return m_timeRef; }
+	inline void setTimeRef(Buffer<time_t>* timeRef) {
+		ASSERT(timeRef != nullptr);
+		ASSERT(timeRef->size() >= RingBuffer<T>::size());
+		m_timeRef = timeRef;
+		m_timeOffset = timeRef->pushes() - this->pushes();
+	}
+
+	inline void setParent(NuBuffer* parent) {
+		ProcessChain<T>::setParent(parent);
+		if (parent != nullptr) {
+			m_timeRef = parent->m_timeRef;
+			m_timeOffset = m_timeRef->pushes() - this->pushes();
+		}
+	}
+
+protected:
+	Buffer<time_t> *m_timeRef;
+	size_t m_timeOffset; // time pushes ahead of value pushes when in step
+
+	NuBuffer(T* data, size_t size, RingState* state,
+		Buffer<time_t>* timeRef,
+		ProcessChain<T>* parent) :
+		Buffer<T>(data, size, state, parent)
+	{
+		setTimeRef(timeRef);
+	}
+
+	// smallest index r >= 1 with timeRef[r] < time, or the last index,
+	// galloping out from start before bisecting
+	inline size_t bracket(time_t time, size_t start) const {
+		const Buffer<time_t>& ref = *m_timeRef;
+		const size_t last = ref.size() - 1;
+		start = clamp(start, size_t(1), last);
+		size_t lo, hi, step = 1;
+		if (ref[start] < time) {
+			hi = start;
+			lo = 0;
+			while (hi > step && ref[hi - step] < time) {
+				hi -= step;
+				step <<= 1;
+			}
+			if (hi > step)
+				lo = hi - step;
+		} else {
+			lo = start;
+			hi = last;
+			while (lo + step < last && !(ref[lo + step] < time)) {
+				lo += step;
+				step <<= 1;
+			}
+			if (lo + step < last)
+				hi = lo + step;
+		}
+		return bisect(time, lo, hi);
+	}
+
+	// the same within (lo, hi]
+	inline size_t bisect(time_t time, size_t lo, size_t hi) const {
+		const Buffer<time_t>& ref = *m_timeRef;
+		while (lo + 1 < hi) {
+			size_t m = (lo + hi) >> 1;
+			if (ref[m] < time)
+				hi = m;
 			else
-				l = m;
+				lo = m;
 		}
+		return std::max(hi, size_t(1));
+	}
+
+	// where time falls between r - 1 and r
+	inline fsize_t position(size_t r, time_t time, SampleType type) const {
+		const Buffer<time_t>& ref = *m_timeRef;
+		size_t l = r - 1;
+		time_t t0 = ref[l], t1 = ref[r];
 		fsize_t result;
 
 		switch (type)
 		{
 		case Nearest:
 		{
-			l = r > 0 ? r - 1 : 0;
-			time_t t0 = m_timeRef->at(l), t1 = m_timeRef->at(r);
-			result = static_cast<fsize_t>((time - t0 < t1 - time) ? l : r);
+			result = static_cast<fsize_t>((t0 - time < time - t1) ? l : r);
 			break;
 		}
 		case Linear:
 		case Spline:
+		case NaturalSpline:
 		{
-			l = r > 0 ? r - 1 : 0;
-			time_t t0 = m_timeRef->at(l), t1 = m_timeRef->at(r);
 			fsize_t ir = (time - t0) / (t1 - t0);
 			ir = clamp(ir, 0, 1);
 			result = static_cast<fsize_t>(l) + ir;
@@ -474,34 +1861,68 @@ public:
 		return result;
 	}
 
-	inline T atTime(time_t time, SampleType type = Nearest) const {
-		return Buffer<T>::sample(seek(time, type), type);
-	}
+	// value at time between r - 1 and r
+	inline T interpolate(size_t r, time_t time, SampleType type) const {
+		if (!Buffer<T>::trait::linear || type == Nearest || type == Linear)
+			return Buffer<T>::sample(position(r, time, type), type);
+
+		const Buffer<time_t>& ref = *m_timeRef;
+		const size_t last = RingBuffer<T>::size() - 1;
+		r = std::min(r, last);
+		// segment from the older sample r to the newer one r - 1
+		size_t l = r - 1;
+		fsize_t x1 = ref[r], x2 = ref[l], h = x2 - x1;
+		if (!(h > 0))
+			return (*this)[l];
+		fsize_t u = clamp((time - x1) / h, 0, 1);
+
+		if (type == Spline) {
+			size_t r0 = std::min(r + 1, last), l0 = (l > 0) ? l - 1 : 0;
+			fsize_t y1 = this->real(r), y2 = this->real(l);
+			fsize_t d1 = slope(ref[r0], this->real(r0), x2, y2);
+			fsize_t d2 = slope(x1, y1, ref[l0], this->real(l0));
+			return Buffer<T>::trait::value(hermite(y1, y2, d1, d2, h, u));
+		}
 
-	inline void to(std::vector<TimeValuePair<T>>& vector) const {
-		ASSERT(m_timeRef != nullptr);
-		vector.clear();
-		for (size_t i = 0; i < std::deque<T>::size(); ++i)
-			vector.emplace_back(TimeValuePair<T>(m_timeRef->at(i),
-				std::deque<T>::at(i)));
+		SplineKnots knots;
+		solveTimeSpline(knots);
+		return timeSpline(knots, r, time);
 	}
 
-	inline Buffer<time_t>* timeRef() const { return m_timeRef; }
-	inline void setTimeRef(Buffer<time_t>* timeRef) {
-		ASSERT(timeRef != nullptr);
-		ASSERT(timeRef->size() >= std::deque<T>::size());
-		m_timeRef = timeRef;
+	// natural spline over time, oldest first
+	inline void solveTimeSpline(SplineKnots& knots) const {
+		const Buffer<time_t>& ref = *m_timeRef;
+		const size_t last = RingBuffer<T>::size() - 1;
+		knots.resize(last + 1);
+		for (size_t i = 0; i <= last; ++i) {
+			knots.x[i] = ref[last - i];
+			knots.y[i] = this->real(last - i);
+		}
+		knots.solve();
 	}
 
-	inline void setParent(NuBuffer* parent) {
-		ProcessChain<T>::setParent(parent);
-		if (parent != nullptr) {
-			m_timeRef = parent->m_timeRef;
-		}
+	// as interpolate() with the spline solved already
+	inline T timeSpline(const SplineKnots& knots, size_t r, time_t time) const {
+		const Buffer<time_t>& ref = *m_timeRef;
+		const size_t last = RingBuffer<T>::size() - 1;
+		r = std::min(r, last);
+		size_t l = r - 1;
+		fsize_t x1 = ref[r], x2 = ref[l], h = x2 - x1;
+		if (!(h > 0))
+			return (*this)[l];
+		fsize_t u = clamp((time - x1) / h, 0, 1);
+		return Buffer<T>::trait::value(knots.at(last - r, h, u));
 	}
 
-protected:
-	Buffer<time_t> *m_timeRef;
+	// index time would have with evenly spaced timestamps
+	inline size_t guess(time_t time) const {
+		const Buffer<time_t>& ref = *m_timeRef;
+		time_t newest = ref.front(), span = newest - ref.back();
+		if (!(span > 0))
+			return 1;
+		fsize_t index = (newest - time) / span * fsize_t(ref.size() - 1);
+		return static_cast<size_t>(clamp(index, fsize_t(1), fsize_t(ref.size() - 1)));
+	}
 };
 
 template<typename T>
@@ -520,13 +1941,14 @@ std::ostream& operator<<(std::ostream& a, const NuBuffer<T>& b) {
 }
 
 template<typename T>
-std::string trace(const NuBuffer<T>& head) {
+std::string trace(const NuBuffer<T>& head, bool costs = false) {
 	struct _buf_info {
 		Buffer<T>* buffer;
 		size_t prev, type, endpos;
 	};
 
 	std::stringstream ss;
+	uint64_t total = costs ? profileTotal<T>(&head) : 0;
 	std::string header, s;
 	std::vector<size_t> stack;
 	std::vector<_buf_info> list;
@@ -553,15 +1975,15 @@ std::string trace(const NuBuffer<T>& head) {
 		switch (buf.type & 0x0f) {
 		case 0:
 		{
-			ss << curr->name() << "[" << curr->size() << "]";
+			ss << curr->name() << "[" << curr->size() << "]" << profileShare<T>(curr, total);
 			break;
 		}
 		case 1:
 		{
 			if ((buf.type & 0xf0) > 0)
-				ss << " ->...-> " << curr->name() << "[" << curr->size() << "]";
+				ss << " ->...-> " << curr->name() << "[" << curr->size() << "]" << profileShare<T>(curr, total);
 			else
-				ss << " -> " << curr->name() << "[" << curr->size() << "]";
+				ss << " -> " << curr->name() << "[" << curr->size() << "]" << profileShare<T>(curr, total);
 			break;
 		}
 		case 2:
@@ -575,7 +1997,7 @@ std::string trace(const NuBuffer<T>& head) {
 				ss << '|';
 			ss << std::string(endpos - list[buf.prev].endpos, '-');
 			endpos = 0;
-			ss << "--> " << curr->name() << "[" << curr->size() << "]";
+			ss << "--> " << curr->name() << "[" << curr->size() << "]" << profileShare<T>(curr, total);
 			break;
 		}
 		}
@@ -0,0 +1,264 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include "filter.h"
+
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <type_traits>
+
+namespace FilterLib {
+
+// radix-2 fft of real sequences through a half size complex transform
+template<typename T>
+class RealFFT {
+public:
+	typedef std::complex<T> Complex;
+
+	explicit RealFFT(size_t size) :
+		m_size(size),
+		m_twiddle(size / 2),
+		m_inverse(size / 2),
+		m_split(size / 2 + 1),
+		m_reverse(size / 2),
+		m_work(size / 2)
+	{
+		ASSERT(size >= 4 && (size & (size - 1)) == 0);
+		const double pi = 3.14159265358979323846;
+		const size_t half = size / 2;
+		// per stage, contiguous: span - 1 + j holds w^j of a stage of 2 * span
+		for (size_t span = 1; span < half; span <<= 1) {
+			for (size_t j = 0; j < span; ++j) {
+				m_twiddle[span - 1 + j] = Complex(T(std::cos(pi * j / span)),
+					T(-std::sin(pi * j / span)));
+				m_inverse[span - 1 + j] = std::conj(m_twiddle[span - 1 + j]);
+			}
+		}
+		for (size_t k = 0; k < m_split.size(); ++k)
+			m_split[k] = Complex(T(std::cos(2 * pi * k / size)), T(-std::sin(2 * pi * k / size)));
+		size_t bits = 0;
+		while ((size_t(1) << bits) < half)
+			++bits;
+		for (size_t k = 0; k < half; ++k) {
+			size_t r = 0;
+			for (size_t b = 0; b < bits; ++b)
+				r |= ((k >> b) & 1) << (bits - 1 - b);
+			m_reverse[k] = r;
+		}
+	}
+
+	inline size_t size() const { return m_size; }
+	inline size_t bins() const { return m_size / 2 + 1; }
+
+	// size real samples to size / 2 + 1 bins, unscaled
+	inline void forward(const T* input, Complex* output) {
+		const size_t half = m_size / 2;
+		for (size_t k = 0; k < half; ++k)
+			m_work[m_reverse[k]] = Complex(input[2 * k], input[2 * k + 1]);
+		transform(false);
+
+		for (size_t k = 0; k <= half; ++k) {
+			const Complex z = m_work[k == half ? 0 : k];
+			const Complex c = std::conj(m_work[k == 0 ? 0 : half - k]);
+			const Complex even = (z + c) * T(0.5);
+			const Complex odd = Complex(z.imag() - c.imag(), c.real() - z.real()) * T(0.5);
+			output[k] = even + multiply(m_split[k], odd);
+		}
+	}
+
+	// size / 2 + 1 bins back to size real samples, scaled by 1 / size
+	inline void inverse(const Complex* input, T* output) {
+		const size_t half = m_size / 2;
+		for (size_t k = 0; k < half; ++k) {
+			const Complex x = input[k];
+			const Complex c = std::conj(input[half - k]);
+			const Complex even = (x + c) * T(0.5);
+			const Complex odd = multiply(std::conj(m_split[k]), x - c) * T(0.5);
+			m_work[m_reverse[k]] = even + Complex(-odd.imag(), odd.real());
+		}
+		transform(true);
+
+		const T scale = T(1) / T(half);
+		for (size_t k = 0; k < half; ++k) {
+			output[2 * k] = m_work[k].real() * scale;
+			output[2 * k + 1] = m_work[k].imag() * scale;
+		}
+	}
+
+protected:
+	size_t m_size;
+	std::vector<Complex> m_twiddle, m_inverse, m_split;
+	std::vector<size_t> m_reverse;
+	std::vector<Complex> m_work;
+
+	// plain products, std::complex operator* goes through nan checks
+	static inline Complex multiply(const Complex& a, const Complex& b) {
+		return Complex(a.real() * b.real() - a.imag() * b.imag(),
+			a.real() * b.imag() + a.imag() * b.real());
+	}
+
+	// in place on bit reversed m_work
+	inline void transform(bool inverse) {
+		const size_t half = m_size / 2;
+		Complex* a = m_work.data();
+		for (size_t i = 0; i < half; i += 2) {
+			const Complex u = a[i], v = a[i + 1];
+			a[i] = u + v;
+			a[i + 1] = u - v;
+		}
+		const Complex* twiddle = inverse ? m_inverse.data() : m_twiddle.data();
+		for (size_t span = 2; span < half; span <<= 1) {
+			const Complex* w = twiddle + span - 1;
+			for (size_t i = 0; i < half; i += 2 * span) {
+				Complex* lo = a + i;
+				Complex* hi = a + i + span;
+				for (size_t j = 0; j < span; ++j) {
+					const Complex u = lo[j];
+					const Complex v = multiply(hi[j], w[j]);
+					lo[j] = u + v;
+					hi[j] = u - v;
+				}
+			}
+		}
+	}
+};
+
+enum ConvolutionMode
+{
+	Auto = 0,
+	Direct,
+	Partitioned,
+};
+
+// fir of any length: direct dot products for short kernels, uniformly
+// partitioned overlap-save for long ones at the cost of latency() samples
+template<typename T>
+class ConvolutionFilter :
+	public Filter<T>
+{
+	static_assert(std::is_floating_point<T>::value,
+		"ConvolutionFilter needs a floating point type");
+
+public:
+	typedef std::complex<T> Complex;
+
+	// kernel length where the partitioned path breaks even with the
+	// default 64 sample latency and wins from there on, see bench_filter
+	static constexpr size_t crossover = 512;
+
+	ConvolutionFilter(const T coeff[], size_t size,
+		size_t latency = 64, ConvolutionMode mode = Auto,
+		ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent),
+		m_partitioned(mode == Partitioned || (mode == Auto && size >= crossover)),
+		m_block(1),
+		m_fill(0),
+		m_current(0),
+		m_direct(m_partitioned ? 1 : size),
+		m_fft(4)
+	{
+		ASSERT(size > 0);
+		if (!m_partitioned) {
+			m_direct.setCoeff(coeff);
+			return;
+		}
+
+		while (m_block < latency || m_block < 2)
+			m_block <<= 1;
+		m_fft = RealFFT<T>(2 * m_block);
+		const size_t bins = m_fft.bins();
+		const size_t partitions = (size + m_block - 1) / m_block;
+
+		std::vector<T> padded(2 * m_block);
+		m_kernel.resize(partitions * bins);
+		for (size_t p = 0; p < partitions; ++p) {
+			std::fill(padded.begin(), padded.end(), T(0));
+			for (size_t k = 0; k < m_block && p * m_block + k < size; ++k)
+				padded[k] = coeff[p * m_block + k];
+			m_fft.forward(padded.data(), &m_kernel[p * bins]);
+		}
+		m_spectra.assign(partitions * bins, Complex());
+		m_sum.resize(bins);
+		m_window.assign(2 * m_block, T(0));
+		m_output.assign(2 * m_block, T(0));
+	}
+
+	inline bool partitioned() const { return m_partitioned; }
+	inline size_t latency() const { return m_partitioned ? m_block : 0; }
+
+	void reserve(size_t n) override {
+		Filter<T>::reserve(n);
+		m_direct.reserve(n);
+	}
+
+protected:
+	bool m_partitioned;
+	size_t m_block, m_fill, m_current;
+	FIRFilter<T> m_direct;
+	RealFFT<T> m_fft;
+	// kernel partition spectra and the delay line of input spectra
+	std::vector<Complex> m_kernel, m_spectra, m_sum;
+	// last two input blocks, oldest first, and the last computed block
+	std::vector<T> m_window, m_output;
+
+	inline T process(const T& input) override {
+		if (!m_partitioned)
+			return m_direct.in(input);
+		m_window[m_block + m_fill] = input;
+		T output = m_output[m_block + m_fill];
+		if (++m_fill == m_block)
+			convolve();
+		return output;
+	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		if (!m_partitioned)
+			return m_direct.in(input, n);
+		T* output = this->block(n);
+		for (size_t i = 0; i < n;) {
+			size_t chunk = std::min(n - i, m_block - m_fill);
+			std::copy(input + i, input + i + chunk, m_window.begin() + m_block + m_fill);
+			std::copy(m_output.begin() + m_block + m_fill,
+				m_output.begin() + m_block + m_fill + chunk, output + i);
+			i += chunk;
+			m_fill += chunk;
+			if (m_fill == m_block)
+				convolve();
+		}
+		return output;
+	}
+
+	inline void convolve() {
+		const size_t bins = m_fft.bins();
+		const size_t partitions = m_kernel.size() / bins;
+
+		m_current = (m_current == 0) ? partitions - 1 : m_current - 1;
+		m_fft.forward(m_window.data(), &m_spectra[m_current * bins]);
+
+		std::fill(m_sum.begin(), m_sum.end(), Complex());
+		for (size_t p = 0; p < partitions; ++p) {
+			// spectrum of the input p blocks ago
+			size_t slot = m_current + p;
+			slot = (slot >= partitions) ? slot - partitions : slot;
+			const Complex* x = &m_spectra[slot * bins];
+			const Complex* h = &m_kernel[p * bins];
+			for (size_t k = 0; k < bins; ++k) {
+				m_sum[k] += Complex(x[k].real() * h[k].real() - x[k].imag() * h[k].imag(),
+					x[k].real() * h[k].imag() + x[k].imag() * h[k].real());
+			}
+		}
+
+		// second half of the circular result is free of wrap-around
+		m_fft.inverse(m_sum.data(), m_output.data());
+		std::copy(m_window.begin() + m_block, m_window.end(), m_window.begin());
+		m_fill = 0;
+	}
+};
+
+template<typename T>
+constexpr size_t ConvolutionFilter<T>::crossover;
+
+}
+
+#endif // CONVOLUTION_H
@@ -2,8 +2,11 @@
 #define FILTER_H
 
 #include "buffer.h"
+#include "simd.h"
 
+#include <cstdint>
 #include <algorithm>
+#include <functional>
 
 namespace FilterLib {
 
@@ -14,6 +17,11 @@ struct Filter_T {
 	static constexpr ValueType unit = ValueType();
 };
 
+template<typename ValueT>
+constexpr typename Filter_T<ValueT>::ValueType Filter_T<ValueT>::zero;
+template<typename ValueT>
+constexpr typename Filter_T<ValueT>::ValueType Filter_T<ValueT>::unit;
+
 template<>
 struct Filter_T<int> {
 	typedef int ValueType;
@@ -21,6 +29,9 @@ struct Filter_T<int> {
 	static constexpr ValueType unit = 1;
 };
 
+constexpr Filter_T<int>::ValueType Filter_T<int>::zero;
+constexpr Filter_T<int>::ValueType Filter_T<int>::unit;
+
 template<>
 struct Filter_T<float> {
 	typedef float ValueType;
@@ -28,6 +39,34 @@ struct Filter_T<float> {
 	static constexpr ValueType unit = 1.f;
 };
 
+constexpr Filter_T<float>::ValueType Filter_T<float>::zero;
+constexpr Filter_T<float>::ValueType Filter_T<float>::unit;
+
+template<>
+struct Filter_T<double> {
+	typedef double ValueType;
+	static constexpr ValueType zero = 0.;
+	static constexpr ValueType unit = 1.;
+};
+
+constexpr Filter_T<double>::ValueType Filter_T<double>::zero;
+constexpr Filter_T<double>::ValueType Filter_T<double>::unit;
+
+// one is out of range, unit is the largest value below it
+template<typename Raw, typename Wide, int Frac>
+struct Filter_T<Fixed<Raw, Wide, Frac>> {
+	typedef Fixed<Raw, Wide, Frac> ValueType;
+	static constexpr ValueType zero = ValueType();
+	static constexpr ValueType unit = ValueType::highest();
+};
+
+template<typename Raw, typename Wide, int Frac>
+constexpr typename Filter_T<Fixed<Raw, Wide, Frac>>::ValueType
+	Filter_T<Fixed<Raw, Wide, Frac>>::zero;
+template<typename Raw, typename Wide, int Frac>
+constexpr typename Filter_T<Fixed<Raw, Wide, Frac>>::ValueType
+	Filter_T<Fixed<Raw, Wide, Frac>>::unit;
+
 template<typename T>
 class AbstractFilter {
 public:
@@ -64,16 +103,22 @@ public:
 
 	virtual ~Filter() { }
 
+	using ProcessChain<T>::in;
+
 	inline T out() const override { return this->m_out; }
 
 	inline T in(const T& input) override {
-		return this->m_out = ProcessChain<T>::in(input);
+		return ProcessChain<T>::in(input);
 	}
 
 protected:
 	virtual inline T process(const T& input) override {
 		return input;
 	}
+
+	inline void commit(const T& output) override {
+		this->m_out = output;
+	}
 };
 
 template<typename T>
@@ -147,14 +192,182 @@ protected:
 			output = Comparator<T>::trait::unit;
 		return output;
 	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		T* output = this->block(n);
+		auto state = this->m_out;
+		for (size_t i = 0; i < n; ++i) {
+			if (input[i] < m_low)
+				state = Comparator<T>::trait::zero;
+			else if (input[i] > m_high)
+				state = Comparator<T>::trait::unit;
+			output[i] = state;
+		}
+		return output;
+	}
 };
 
-template<typename T>
+// size of a sliding window, N > 0 fixes it at compile time and size has
+// to match it
+template<size_t N>
+inline size_t windowSize(size_t size) {
+	if (size == 0 || (N > 0 && size != N))
+		throw std::invalid_argument("window size is zero or differs from N");
+	return size;
+}
+
+// extreme of the last size values by a monotonic deque, amortized O(1)
+// per push and never more than size comparisons. N > 0 fixes the size at
+// compile time and keeps the deque inline
+template<typename T, typename Compare, size_t N = 0>
+class SlidingExtreme {
+public:
+	SlidingExtreme(size_t size, const T& initial) :
+		m_values(windowSize<N>(size), initial),
+		m_stamps(size, 0),
+		m_first(0),
+		m_count(1),
+		m_time(0)
+	{
+
+	}
+
+	inline size_t size() const { return m_values.size(); }
+	inline const T& value() const { return m_values[m_first]; }
+
+	inline const T& push(const T& input) {
+		++m_time;
+		if (m_stamps[m_first] + size() <= m_time) {
+			m_first = slot(1);
+			--m_count;
+		}
+		// entries not beating the newer input can never be extreme again
+		while (m_count > 0 && !m_compare(m_values[slot(m_count - 1)], input))
+			--m_count;
+		auto last = slot(m_count++);
+		m_values[last] = input;
+		m_stamps[last] = m_time;
+		return m_values[m_first];
+	}
+
+	inline void relocate(Arena& arena) {
+		arena.place(m_values);
+		arena.place(m_stamps);
+	}
+
+protected:
+	Storage<T, N> m_values;
+	Storage<size_t, N> m_stamps;
+	size_t m_first, m_count, m_time;
+	Compare m_compare;
+
+	inline size_t slot(size_t i) const {
+		i += m_first;
+		if (N > 0 && (N & (N - 1)) == 0)
+			return i & (N - 1);
+		return (i >= size()) ? i - size() : i;
+	}
+};
+
+// N > 0 takes the window size as a template argument
+template<typename T, size_t N = 0>
 class HoldHigh :
 	public Filter<T>
 {
 public:
+	// a nonzero N has to be matched by size, see windowSize()
 	HoldHigh(size_t size, ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent),
+		m_extreme(size, this->m_out)
+	{
+
+	}
+
+	explicit HoldHigh(ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent),
+		m_extreme(N, this->m_out)
+	{
+		static_assert(N > 0, "window size missing");
+	}
+
+protected:
+	SlidingExtreme<T, std::greater<T>, N> m_extreme;
+
+	inline T process(const T& input) override {
+		return m_extreme.push(input);
+	}
+
+	void relocate(Arena& arena) override {
+		m_extreme.relocate(arena);
+	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		T* output = this->block(n);
+		for (size_t i = 0; i < n; ++i)
+			output[i] = m_extreme.push(input[i]);
+		return output;
+	}
+};
+
+// N > 0 takes the window size as a template argument
+template<typename T, size_t N = 0>
+class HoldLow :
+	public Filter<T>
+{
+public:
+	// a nonzero N has to be matched by size, see windowSize()
+	HoldLow(size_t size, ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent),
+		m_extreme(size, this->m_out)
+	{
+
+	}
+
+	explicit HoldLow(ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent),
+		m_extreme(N, this->m_out)
+	{
+		static_assert(N > 0, "window size missing");
+	}
+
+protected:
+	SlidingExtreme<T, std::less<T>, N> m_extreme;
+
+	inline T process(const T& input) override {
+		return m_extreme.push(input);
+	}
+
+	void relocate(Arena& arena) override {
+		m_extreme.relocate(arena);
+	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		T* output = this->block(n);
+		for (size_t i = 0; i < n; ++i)
+			output[i] = m_extreme.push(input[i]);
+		return output;
+	}
+};
+
+// extreme of a whole ring, straight over the runs it occupies
+template<typename T, typename Compare>
+inline T extreme(const RingBuffer<T>& ring, Compare compare) {
+	RingView<const T> view = ring.view();
+	T result = view.first[0];
+	for (const T& value : view.first)
+		result = compare(value, result) ? value : result;
+	for (const T& value : view.second)
+		result = compare(value, result) ? value : result;
+	return result;
+}
+
+// reference HoldHigh, rescans the window when the maximum leaves it
+template<typename T>
+class ScanHoldHigh :
+	public Filter<T>
+{
+public:
+	ScanHoldHigh(size_t size, ProcessChain<T>* parent = nullptr) :
 		Filter<T>(parent),
 		m_input(size)
 	{
@@ -171,18 +384,30 @@ protected:
 		if (input >= output)
 			output = input;
 		else if (output == last)
-			output = *(std::max_element(m_input.cbegin(), m_input.cend()));
+			output = extreme(m_input, std::greater<T>());
 		// else not changed
 		return output;
 	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		T* output = this->block(n);
+		for (size_t i = 0; i < n; ++i)
+			output[i] = this->m_out = ScanHoldHigh::process(input[i]);
+		return output;
+	}
+
+	void relocate(Arena& arena) override {
+		m_input.relocate(arena);
+	}
 };
 
+// reference HoldLow, rescans the window when the minimum leaves it
 template<typename T>
-class HoldLow :
+class ScanHoldLow :
 	public Filter<T>
 {
 public:
-	HoldLow(size_t size, ProcessChain<T>* parent = nullptr) :
+	ScanHoldLow(size_t size, ProcessChain<T>* parent = nullptr) :
 		Filter<T>(parent),
 		m_input(size)
 	{
@@ -196,13 +421,24 @@ protected:
 		auto last = m_input.back();
 		auto output = this->m_out;
 		m_input.in(input);
-		if (input >= output)
+		if (input <= output)
 			output = input;
 		else if (output == last)
-			output = *(std::min_element(m_input.cbegin(), m_input.cend()));
+			output = extreme(m_input, std::less<T>());
 		// else not changed
 		return output;
 	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		T* output = this->block(n);
+		for (size_t i = 0; i < n; ++i)
+			output[i] = this->m_out = ScanHoldLow::process(input[i]);
+		return output;
+	}
+
+	void relocate(Arena& arena) override {
+		m_input.relocate(arena);
+	}
 };
 
 template <typename T>
@@ -229,77 +465,427 @@ protected:
 	inline T process(const T& input) override {
 		return (input < m_low) ? m_low : (input > m_high) ? m_high : input;
 	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		T* output = this->block(n);
+		const T low = m_low, high = m_high;
+		for (size_t i = 0; i < n; ++i) {
+			const T value = input[i];
+			output[i] = (value < low) ? low : (value > high) ? high : value;
+		}
+		return output;
+	}
 };
 
+// exponential moving average, alpha is the weight of the newest input
 template<typename T>
-class MidAntiJitter :
+class EMAFilter :
 	public Filter<T>
 {
 public:
-	MidAntiJitter(size_t size, ProcessChain<T>* parent = nullptr) :
-		Filter<T>(),
-		m_input(size, parent)
+	EMAFilter(fsize_t alpha = fsize_t(0.1), ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent),
+		m_alpha(alpha)
 	{
-		ProcessChain<T>::setParent(&m_input);
+
+	}
+
+	inline fsize_t alpha() const { return m_alpha; }
+	inline void setAlpha(fsize_t alpha) {
+		m_alpha = alpha;
 	}
 
 protected:
-	Buffer<T> m_input;
-	std::vector<T> m_tmpBuf;
+	fsize_t m_alpha;
 
 	inline T process(const T& input) override {
-		(void)(input);
-		m_input.to(m_tmpBuf);
-		std::sort(m_tmpBuf.begin(), m_tmpBuf.end());
-		return m_tmpBuf[m_input.size() / 2];
+		return Buffer_T<T>::mix(this->m_out, input, m_alpha);
+	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		T* output = this->block(n);
+		auto state = this->m_out;
+		for (size_t i = 0; i < n; ++i)
+			output[i] = state = Buffer_T<T>::mix(state, input[i], m_alpha);
+		return output;
 	}
 };
 
-//template <>
+// sorted multiset of up to capacity values with O(log n) insert, erase
+// and rank lookup, an indexable skiplist over a node pool sized up front
+template<typename T>
+class IndexableSkiplist {
+public:
+	IndexableSkiplist(size_t capacity) :
+		m_levels(1),
+		m_size(0),
+		m_free(nil),
+		m_seed(0x9e3779b9u),
+		m_values(capacity + 1, T()),
+		m_height(capacity + 1, 0)
+	{
+		while (m_levels < maxLevels && (size_t(1) << m_levels) <= capacity)
+			++m_levels;
+		m_links = Storage<Link>((capacity + 1) * m_levels, Link());
+		for (size_t level = 0; level < m_levels; ++level)
+			link(head, level) = { nil, 1 };
+		for (size_t node = capacity; node > head; --node) {
+			link(node, 0).next = m_free;
+			m_free = node;
+		}
+	}
+
+	inline size_t size() const { return m_size; }
+	inline size_t capacity() const { return m_values.size() - 1; }
+
+	// rank 0 is the smallest value
+	inline const T& at(size_t rank) const {
+		ASSERT(rank < m_size);
+		size_t node = head, i = rank + 1;
+		for (size_t level = m_levels; level-- > 0;) {
+			while (link(node, level).next != nil && link(node, level).width <= i) {
+				i -= link(node, level).width;
+				node = link(node, level).next;
+			}
+		}
+		return m_values[node];
+	}
+
+	inline void insert(const T& value) {
+		ASSERT(m_free != nil);
+		size_t chain[maxLevels], steps[maxLevels], node = head, step = 0;
+		for (size_t level = m_levels; level-- > 0;) {
+			while (link(node, level).next != nil &&
+					!(value < m_values[link(node, level).next])) {
+				step += link(node, level).width;
+				node = link(node, level).next;
+			}
+			chain[level] = node;
+			steps[level] = step;
+		}
+
+		size_t created = m_free, height = randomHeight();
+		m_free = link(created, 0).next;
+		m_values[created] = value;
+		m_height[created] = height;
+		for (size_t level = 0; level < height; ++level) {
+			auto &prev = link(chain[level], level);
+			link(created, level) = { prev.next, prev.width - (step - steps[level]) };
+			prev.next = created;
+			prev.width = step - steps[level] + 1;
+		}
+		for (size_t level = height; level < m_levels; ++level)
+			link(chain[level], level).width++;
+		++m_size;
+	}
+
+	// removes one element equal to value, which must be present
+	inline void erase(const T& value) {
+		size_t chain[maxLevels], node = head;
+		for (size_t level = m_levels; level-- > 0;) {
+			while (link(node, level).next != nil &&
+					m_values[link(node, level).next] < value)
+				node = link(node, level).next;
+			chain[level] = node;
+		}
+
+		size_t removed = link(chain[0], 0).next;
+		ASSERT(removed != nil && !(value < m_values[removed]));
+		size_t height = m_height[removed];
+		for (size_t level = 0; level < height; ++level) {
+			auto &prev = link(chain[level], level);
+			prev.width += link(removed, level).width - 1;
+			prev.next = link(removed, level).next;
+		}
+		for (size_t level = height; level < m_levels; ++level)
+			link(chain[level], level).width--;
+		link(removed, 0).next = m_free;
+		m_free = removed;
+		--m_size;
+	}
+
+	inline void relocate(Arena& arena) {
+		arena.place(m_values);
+		arena.place(m_height);
+		arena.place(m_links);
+	}
+
+protected:
+	struct Link {
+		size_t next, width;
+	};
+
+	static constexpr size_t maxLevels = 32;
+	static constexpr size_t head = 0;
+	static constexpr size_t nil = ~size_t(0);
+
+	size_t m_levels, m_size, m_free;
+	uint32_t m_seed;
+	Storage<T> m_values;
+	Storage<size_t> m_height;
+	Storage<Link> m_links;
+
+	inline Link& link(size_t node, size_t level) {
+		return m_links[node * m_levels + level];
+	}
+	inline const Link& link(size_t node, size_t level) const {
+		return m_links[node * m_levels + level];
+	}
+
+	inline size_t randomHeight() {
+		// xorshift32, each extra level with probability 1/2
+		m_seed ^= m_seed << 13;
+		m_seed ^= m_seed >> 17;
+		m_seed ^= m_seed << 5;
+		size_t height = 1;
+		for (uint32_t bits = m_seed; (bits & 1) && height < m_levels; bits >>= 1)
+			++height;
+		return height;
+	}
+};
+
+// sorted values in one array, O(n) moves but a tiny constant, beats the
+// skiplist's unpredictable branches for windows below a few thousand
+template<typename T>
+class SortedArray {
+public:
+	SortedArray(size_t capacity) :
+		m_size(0),
+		m_values(capacity, T())
+	{
+
+	}
+
+	inline size_t size() const { return m_size; }
+	inline size_t capacity() const { return m_values.size(); }
+	inline const T& at(size_t rank) const { return m_values[rank]; }
+
+	inline void insert(const T& value) {
+		ASSERT(m_size < capacity());
+		auto end = m_values.begin() + m_size++;
+		auto it = std::upper_bound(m_values.begin(), end, value);
+		std::copy_backward(it, end, end + 1);
+		*it = value;
+	}
+
+	inline void erase(const T& value) {
+		auto end = m_values.begin() + m_size--;
+		auto it = std::lower_bound(m_values.begin(), end, value);
+		ASSERT(it != end);
+		std::copy(it + 1, end, it);
+	}
+
+	// erase(value) and insert(input) with a single move
+	inline void replace(const T& value, const T& input) {
+		auto end = m_values.begin() + m_size;
+		auto from = std::lower_bound(m_values.begin(), end, value);
+		auto to = std::upper_bound(m_values.begin(), end, input);
+		ASSERT(from != end);
+		if (to > from) {
+			std::copy(from + 1, to, from);
+			*(to - 1) = input;
+		}
+		else {
+			std::copy_backward(to, from, from + 1);
+			*to = input;
+		}
+	}
+
+	inline void relocate(Arena& arena) {
+		arena.place(m_values);
+	}
+
+protected:
+	size_t m_size;
+	Storage<T> m_values;
+};
+
+// rank-th smallest value of the last size inputs, O(log size) per sample
+// through the skiplist for large windows, a sorted array below
+template<typename T>
+class RankFilter :
+	public Filter<T>
+{
+public:
+	// measured crossover of the two engines
+	static constexpr size_t skiplistSize = 16384;
+
+	RankFilter(size_t size, size_t rank, ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent),
+		m_rank(0),
+		m_indexed(size >= skiplistSize),
+		m_input(size, Buffer_T<T>::zero),
+		m_array(m_indexed ? 0 : size),
+		m_list(m_indexed ? size : 0)
+	{
+		for (size_t i = 0; i < size; ++i) {
+			if (m_indexed)
+				m_list.insert(m_input[i]);
+			else
+				m_array.insert(m_input[i]);
+		}
+		setRank(rank);
+	}
+
+	inline size_t rank() const { return m_rank; }
+	inline void setRank(size_t rank) {
+		m_rank = std::min(rank, m_input.size() - 1);
+	}
+
+	// 0 picks the window minimum, 1 the maximum
+	inline void setPercentile(fsize_t percentile) {
+		percentile = clamp(percentile, fsize_t(0), fsize_t(1));
+		setRank(size_t(std::round(percentile * (m_input.size() - 1))));
+	}
+
+protected:
+	size_t m_rank;
+	bool m_indexed;
+	RingBuffer<T> m_input;
+	SortedArray<T> m_array;
+	IndexableSkiplist<T> m_list;
+
+	inline T process(const T& input) override {
+		auto evicted = m_input.back();
+		m_input.push(input);
+		if (m_indexed) {
+			m_list.erase(evicted);
+			m_list.insert(input);
+			return m_list.at(m_rank);
+		}
+		m_array.replace(evicted, input);
+		return m_array.at(m_rank);
+	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		T* output = this->block(n);
+		for (size_t i = 0; i < n; ++i)
+			output[i] = RankFilter::process(input[i]);
+		return output;
+	}
+
+	void relocate(Arena& arena) override {
+		m_input.relocate(arena);
+		m_array.relocate(arena);
+		m_list.relocate(arena);
+	}
+};
+
+template<typename T>
+class MidAntiJitter :
+	public RankFilter<T>
+{
+public:
+	MidAntiJitter(size_t size, ProcessChain<T>* parent = nullptr) :
+		RankFilter<T>(size, size / 2, parent)
+	{
+
+	}
+};
+
+// per-bin counts with O(log n) updates and cumulative searches
+class FenwickTree {
+public:
+	FenwickTree(size_t size) :
+		m_total(0),
+		m_step(1),
+		m_tree(size + 1, 0)
+	{
+		while ((m_step << 1) <= size)
+			m_step <<= 1;
+	}
+
+	inline size_t size() const { return m_tree.size() - 1; }
+	inline size_t total() const { return m_total; }
+
+	inline void add(size_t bin, ptrdiff_t delta) {
+		m_total += delta;
+		for (size_t i = bin + 1; i < m_tree.size(); i += i & (~i + 1))
+			m_tree[i] += delta;
+	}
+
+	// number of leading bins whose counts sum up to no more than count,
+	// which is also the first bin where the running sum exceeds it
+	inline size_t search(size_t count) const {
+		size_t pos = 0;
+		for (size_t step = m_step; step > 0; step >>= 1) {
+			size_t next = pos + step;
+			if (next < m_tree.size() && m_tree[next] <= count) {
+				pos = next;
+				count -= m_tree[next];
+			}
+		}
+		return pos;
+	}
+
+	inline void relocate(Arena& arena) {
+		arena.place(m_tree);
+	}
+
+protected:
+	size_t m_total, m_step;
+	Storage<size_t> m_tree;
+};
+
+template<typename T>
 class HistAntiJitter :
-	public Filter<float>
+	public Filter<T>
 {
 public:
 	HistAntiJitter(size_t size, size_t histSize,
-		float tMin, float tMax,
-		float margin = 0.05f, ProcessChain<float>* parent = nullptr) :
-		Filter<float>(),
+		T tMin, T tMax,
+		fsize_t margin = 0.05f, ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent),
 		m_histSize(histSize),
-		m_margin(size_t(size * margin)),
+		m_margin(size_t(size * checkedMargin(margin))),
 		m_tMin(tMin),
 		m_tMax(tMax),
 		m_tSpan(tMax - tMin),
-		m_histogram(histSize, 0),
-		m_input(size, parent)
+		m_realMin(double(tMin)),
+		m_realSpan(double(tMax) - double(tMin)),
+		m_fixed(0),
+		m_histogram(histSize),
+		m_input(size, HistAntiJitter<T>::trait::zero)
 	{
-		ProcessChain<float>::setParent(&m_input);
-		m_histogram[which(0)] = size;
+		ASSERT(histSize > 1 && !(tMax < tMin));
+		// bin = offset * (histSize - 1) / span as a 32.32 multiply, exact
+		// while span * span stays below 2^32. An empty range clamps every
+		// value to offset 0, bin 0, with any scale
+		if (std::is_integral<T>::value && m_realSpan == 0)
+			m_fixed = 1;
+		else if (std::is_integral<T>::value && uint64_t(m_realSpan) < (uint64_t(1) << 16))
+			m_fixed = ((uint64_t(histSize - 1) << 32) + uint64_t(m_realSpan) - 1) / uint64_t(m_realSpan);
+		m_histogram.add(which(HistAntiJitter<T>::trait::zero), size);
 	}
 
 protected:
 	size_t m_histSize, m_margin;
-	float m_tMin, m_tMax, m_tSpan;
-	std::vector<size_t> m_histogram;
-	Buffer<float> m_input;
+	T m_tMin, m_tMax, m_tSpan;
+	// the span of a Fixed may not fit in one
+	double m_realMin, m_realSpan;
+	uint64_t m_fixed;
+	FenwickTree m_histogram;
+	RingBuffer<T> m_input;
+
+	// from 0.5 on the low and the high bin cross
+	static inline fsize_t checkedMargin(fsize_t margin) {
+		if (!(margin >= 0 && margin < 0.5f))
+			throw std::invalid_argument("HistAntiJitter: margin outside [0, 0.5)");
+		return margin;
+	}
 
-	inline float process(const float& input) override {
+	inline T process(const T& input) override {
 		auto hLast = which(m_input.back());
 		auto hCurrent = which(input);
-		ASSERT(m_histogram[hLast] > 0);
-		m_histogram[hLast]--;
-		m_histogram[hCurrent]++;
-
-		size_t hLow = 0, hHigh = m_histSize - 1, acc;
-		acc = 0;
-		while (acc <= m_margin) {
-			acc += m_histogram[hLow++];
-		}
-		hLow--;
-		acc = 0;
-		while (acc <= m_margin) {
-			acc += m_histogram[hHigh--];
-		}
-		hHigh++;
+		m_input.push(input);
+		m_histogram.add(hLast, -1);
+		m_histogram.add(hCurrent, 1);
+
+		// first bins from either end where the count passes the margin,
+		// ranks kept below total so both are real bins
+		size_t total = m_histogram.total(), rank = std::min(m_margin, total - 1);
+		size_t hLow = m_histogram.search(rank);
+		size_t hHigh = m_histogram.search(total - 1 - rank);
 
 		auto output = input;
 		if (hCurrent < hLow) {
@@ -312,20 +898,62 @@ protected:
 		return output;
 	}
 
-	inline float what(size_t h) const {
-		return m_tSpan * h / (m_histSize - 1) + m_tMin;
+	inline const T* processBlock(const T* input, size_t n) override {
+		T* output = this->block(n);
+		for (size_t i = 0; i < n; ++i)
+			output[i] = HistAntiJitter::process(input[i]);
+		return output;
+	}
+
+	void relocate(Arena& arena) override {
+		m_histogram.relocate(arena);
+		m_input.relocate(arena);
+	}
+
+	inline T what(size_t h) const {
+		return what(h, std::is_arithmetic<T>());
 	}
 
-	inline size_t which(const float& value) const {
-		float h = (value - m_tMin) / m_tSpan;
+	inline T what(size_t h, std::true_type) const {
+		return T(m_tSpan * h / (m_histSize - 1) + m_tMin);
+	}
+
+	inline T what(size_t h, std::false_type) const {
+		return T(m_realSpan * double(h) / double(m_histSize - 1) + m_realMin);
+	}
+
+	inline size_t which(const T& value) const {
+		return which(value, std::is_integral<T>(), std::is_arithmetic<T>());
+	}
+
+	// an empty range puts everything in bin 0
+	inline size_t which(const T& value, std::false_type, std::true_type) const {
+		if (!(m_tSpan > 0))
+			return 0;
+		fsize_t h = fsize_t(value - m_tMin) / fsize_t(m_tSpan);
 		h = (h < 0) ? 0 : h;
 		h = (h > 1) ? 1 : h;
-		h *= float(m_histSize - 1);
+		h *= fsize_t(m_histSize - 1);
 		return size_t(h);
 	}
-};
 
+	inline size_t which(const T& value, std::false_type, std::false_type) const {
+		if (!(m_realSpan > 0))
+			return 0;
+		double h = (double(value) - m_realMin) / m_realSpan;
+		h = (h < 0) ? 0 : h;
+		h = (h > 1) ? 1 : h;
+		h *= double(m_histSize - 1);
+		return size_t(h);
+	}
 
+	inline size_t which(const T& value, std::true_type, std::true_type) const {
+		T v = clamp(value, m_tMin, m_tMax);
+		if (m_fixed == 0)
+			return size_t(v - m_tMin) * (m_histSize - 1) / size_t(m_tSpan);
+		return size_t((uint64_t(v - m_tMin) * m_fixed) >> 32);
+	}
+};
 
 
 
@@ -341,102 +969,198 @@ protected:
 
 
 
-//template<typename T>
-//class FIRFilter :
-//		public Buffer<T>
-//{
-//public:
-//	explicit FIRFilter(size_t size, Buffer<T>* parent = nullptr) :
-//		Buffer<T>(size, parent),
-//		m_input(size),
-//		m_coeff(new T[size]),
-//		m_scale(1)
-//	{
 
-//	}
 
-//	virtual ~FIRFilter() {
-//		delete this->m_coeff;
-//	}
+// finite impulse response, coeff[0] weights the newest input
+template<typename T>
+class FIRFilter :
+	public Filter<T>
+{
+public:
+	explicit FIRFilter(size_t size, ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent),
+		m_pos(0),
+		m_scale(FIRFilter<T>::trait::unit),
+		m_history(2 * size, FIRFilter<T>::trait::zero),
+		m_kernel(size, FIRFilter<T>::trait::zero),
+		m_dot(simd::Kernel<T>::dot())
+	{
+		ASSERT(size > 0);
+	}
 
-//	virtual inline void setCoeff(const T coeff[], T scale = 1) {
-//		memcpy(this->m_coeff, coeff, sizeof(T) * this->m_size);
-//		m_scale = scale;
-//	}
+	inline size_t size() const { return m_kernel.size(); }
 
-//	virtual inline T step(const T& value) {
-//		this->shift();
-//		this->write(m_input.step(value));
+	inline void setCoeff(const T coeff[], T scale = FIRFilter<T>::trait::unit) {
+		// history runs oldest to newest, so the kernel is stored reversed
+		std::reverse_copy(coeff, coeff + size(), m_kernel.begin());
+		m_scale = scale;
+	}
 
-//		T result = 0;
-//		for (size_t i = 0; i<this->m_size; ++i)
-//			result += this->m_input[i] * this->m_coeff[i];
-//		result /= this->m_scale;
+	// restricts the dot product kernel, mainly for testing
+	inline void setIsa(simd::Isa isa) {
+		m_dot = simd::Kernel<T>::dot(isa);
+	}
 
-//		this->store(result);
+	void reserve(size_t n) override {
+		Filter<T>::reserve(n);
+		if (m_linear.size() < size() - 1 + n)
+			m_linear.resize(size() - 1 + n);
+	}
 
-//		if (this->m_simbling != nullptr)
-//			static_cast<Buffer<T>*>(this->m_simbling)->step(value);
-//		if (this->m_child != nullptr)
-//			static_cast<Buffer<T>*>(this->m_child)->step(result);
+protected:
+	size_t m_pos;
+	T m_scale;
+	// every sample is written twice, size apart, so the window always
+	// is one contiguous run m_history[m_pos + 1 .. m_pos + size]
+	Storage<T> m_history;
+	Storage<T> m_kernel;
+	std::vector<T> m_linear; // scratch of processBlock
+	typename simd::Kernel<T>::Dot m_dot;
 
-//		return result;
-//	}
+	inline T process(const T& input) override {
+		m_pos = (m_pos + 1 == size()) ? 0 : m_pos + 1;
+		m_history[m_pos] = input;
+		m_history[m_pos + size()] = input;
+		// the newest tap is taken from the register, a vector load over
+		// the slot just written would stall on store forwarding
+		return (m_dot(m_history.data() + m_pos + 1, m_kernel.data(), size() - 1) +
+			input * m_kernel.back()) / m_scale;
+	}
 
-//protected:
-//	Buffer<T> m_input;
-//	T *m_coeff, m_scale;
-//};
+	// dot products over a linear copy of the window followed by the block,
+	// its stores have long retired when the products read them
+	inline const T* processBlock(const T* input, size_t n) override {
+		T* output = this->block(n);
+		const size_t tail = size() - 1;
+		T* linear = scratch(m_linear, tail + n);
+		std::copy(m_history.begin() + m_pos + 2, m_history.begin() + m_pos + 1 + size(),
+			linear);
+		std::copy(input, input + n, linear + tail);
+		for (size_t i = 0; i < n; ++i)
+			output[i] = m_dot(linear + i, m_kernel.data(), size()) / m_scale;
+
+		for (size_t i = (n > size()) ? n - size() : 0; i < n; ++i) {
+			m_pos = (m_pos + 1 == size()) ? 0 : m_pos + 1;
+			m_history[m_pos] = input[i];
+			m_history[m_pos + size()] = input[i];
+		}
+		return output;
+	}
 
-//template<typename T>
-//class IIRFilter :
-//		public Buffer<T>
-//{
-//public:
-//	explicit IIRFilter(size_t size, Buffer<T>* parent = nullptr) :
-//		Buffer<T>(size, parent),
-//		m_input(size),
-//		m_coeffA(new T[size]),
-//		m_coeffB(new T[size])
-//	{
-//		this->m_input.fill(0);
-//	}
+	void relocate(Arena& arena) override {
+		arena.place(m_history);
+		arena.place(m_kernel);
+	}
+};
 
-//	virtual ~IIRFilter() {
-//		delete this->m_coeffB;
-//		delete this->m_coeffA;
-//	}
+// cascade of second order sections in transposed direct form II,
+// coefficients and state are kept per field across sections
+template<typename T>
+class IIRFilter :
+	public Filter<T>
+{
+public:
+	explicit IIRFilter(size_t sections, ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent),
+		m_b0(sections, IIRFilter<T>::trait::unit),
+		m_b1(sections, IIRFilter<T>::trait::zero),
+		m_b2(sections, IIRFilter<T>::trait::zero),
+		m_a1(sections, IIRFilter<T>::trait::zero),
+		m_a2(sections, IIRFilter<T>::trait::zero),
+		m_z1(sections, IIRFilter<T>::trait::zero),
+		m_z2(sections, IIRFilter<T>::trait::zero)
+	{
+		ASSERT(sections > 0);
+	}
 
-//	virtual inline void setCoeff(const T coeffA[], const T coeffB[]) {
-//		memcpy(this->m_coeffA, coeffA, sizeof(T) * this->m_size);
-//		memcpy(this->m_coeffB, coeffB, sizeof(T) * this->m_size);
-//	}
+	inline size_t sections() const { return m_b0.size(); }
 
-//	virtual inline T step(const T& value) {
-//		this->shift();
-//		this->write(this->m_input.step(value));
+	// y = (b0 + b1 z^-1 + b2 z^-2) / (a0 + a1 z^-1 + a2 z^-2) x
+	inline void setSection(size_t i, T b0, T b1, T b2, T a0, T a1, T a2) {
+		m_b0[i] = b0 / a0;
+		m_b1[i] = b1 / a0;
+		m_b2[i] = b2 / a0;
+		m_a1[i] = a1 / a0;
+		m_a2[i] = a2 / a0;
+	}
 
-//		T result = 0;
-//		for (size_t i = 0; i<this->m_size; ++i)
-//			result += this->m_input[i] * this->m_coeffB[i];
-//		for (size_t i = this->m_size - 1; i>0; --i)
-//			result -= this->at(i) * this->m_coeffA[i];
-//		result /= this->m_coeffA[0];
+	// lowpass of order 2 * sections(), cutoff relative to the sample rate
+	inline void setButterworthLowpass(double cutoff) {
+		const double pi = 3.14159265358979323846;
+		const size_t order = 2 * sections();
+		double w0 = 2 * pi * cutoff, cosw = std::cos(w0), sinw = std::sin(w0);
+		for (size_t i = 0; i < sections(); ++i) {
+			double q = 1 / (2 * std::sin(pi * (2 * i + 1) / (2 * order)));
+			double alpha = sinw / (2 * q);
+			setSection(i, T((1 - cosw) / 2), T(1 - cosw), T((1 - cosw) / 2),
+				T(1 + alpha), T(-2 * cosw), T(1 - alpha));
+		}
+	}
 
-//		this->store(result);
+	inline void reset() {
+		std::fill(m_z1.begin(), m_z1.end(), IIRFilter<T>::trait::zero);
+		std::fill(m_z2.begin(), m_z2.end(), IIRFilter<T>::trait::zero);
+	}
 
-//		if (this->m_simbling != nullptr)
-//			static_cast<Buffer<T>*>(this->m_simbling)->step(value);
-//		if (this->m_child != nullptr)
-//			static_cast<Buffer<T>*>(this->m_child)->step(result);
+protected:
+	std::vector<T> m_b0, m_b1, m_b2, m_a1, m_a2;
+	std::vector<T> m_z1, m_z2;
 
-//		return result;
-//	}
+	inline T process(const T& input) override {
+		T x = input;
+		for (size_t i = 0; i < sections(); ++i) {
+			T y = m_b0[i] * x + m_z1[i];
+			m_z1[i] = m_b1[i] * x - m_a1[i] * y + m_z2[i];
+			m_z2[i] = m_b2[i] * x - m_a2[i] * y;
+			x = y;
+		}
+		return x;
+	}
 
-//protected:
-//	Buffer<T> m_input;
-//	T *m_coeffA, *m_coeffB;
-//};
+	// whole block through two sections at a time, their coefficients and
+	// state stay in registers and the two recurrences overlap
+	inline const T* processBlock(const T* input, size_t n) override {
+		T* output = this->block(n);
+		std::copy(input, input + n, output);
+		size_t i = 0;
+		for (; i + 2 <= sections(); i += 2) {
+			const T b0 = m_b0[i], b1 = m_b1[i], b2 = m_b2[i];
+			const T a1 = m_a1[i], a2 = m_a2[i];
+			const T d0 = m_b0[i + 1], d1 = m_b1[i + 1], d2 = m_b2[i + 1];
+			const T c1 = m_a1[i + 1], c2 = m_a2[i + 1];
+			T z1 = m_z1[i], z2 = m_z2[i], w1 = m_z1[i + 1], w2 = m_z2[i + 1];
+			for (size_t j = 0; j < n; ++j) {
+				T x = output[j];
+				T y = b0 * x + z1;
+				z1 = b1 * x - a1 * y + z2;
+				z2 = b2 * x - a2 * y;
+				T v = d0 * y + w1;
+				w1 = d1 * y - c1 * v + w2;
+				w2 = d2 * y - c2 * v;
+				output[j] = v;
+			}
+			m_z1[i] = z1;
+			m_z2[i] = z2;
+			m_z1[i + 1] = w1;
+			m_z2[i + 1] = w2;
+		}
+		for (; i < sections(); ++i) {
+			const T b0 = m_b0[i], b1 = m_b1[i], b2 = m_b2[i];
+			const T a1 = m_a1[i], a2 = m_a2[i];
+			T z1 = m_z1[i], z2 = m_z2[i];
+			for (size_t j = 0; j < n; ++j) {
+				T x = output[j];
+				T y = b0 * x + z1;
+				z1 = b1 * x - a1 * y + z2;
+				z2 = b2 * x - a2 * y;
+				output[j] = y;
+			}
+			m_z1[i] = z1;
+			m_z2[i] = z2;
+		}
+		return output;
+	}
+};
 
 }
 
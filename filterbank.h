@@ -0,0 +1,487 @@
+#ifndef FILTERBANK_H
+#define FILTERBANK_H
+
+#include "filter.h"
+
+namespace FilterLib {
+
+// ProcessChain over frames, one value per channel, every node of a
+// chain has the same number of channels
+template<typename T>
+class BankChain {
+public:
+	BankChain(size_t channels, BankChain* parent = nullptr) :
+		m_channels(channels),
+		m_parent(nullptr),
+		m_child(nullptr),
+		m_simbling(nullptr)
+	{
+		ASSERT(channels > 0);
+		setParent(parent);
+	}
+
+	virtual ~BankChain() { }
+
+	inline size_t channels() const { return m_channels; }
+
+	inline BankChain* parent() const { return m_parent; }
+	inline void setParent(BankChain* parent) {
+		ASSERT(m_parent == nullptr);
+		if (parent != nullptr) {
+			ASSERT(parent->m_channels == m_channels);
+			m_parent = parent;
+			m_simbling = parent->m_child;
+			parent->m_child = this;
+		}
+	}
+
+	inline BankChain* first() const { return m_child; }
+	inline BankChain* next() const { return m_simbling; }
+
+	// frame of channels() values, returned frame is valid until the next call
+	inline const T* in(const T* frame) {
+		const T* output = processFrame(frame);
+		if (m_simbling != nullptr)
+			m_simbling->in(frame);
+		if (m_child != nullptr)
+			m_child->in(output);
+		return output;
+	}
+
+	inline const T* in(const std::vector<T>& frame) {
+		ASSERT(frame.size() == m_channels);
+		return in(frame.data());
+	}
+
+	virtual const T* out() const = 0;
+	inline T out(size_t channel) const { return out()[channel]; }
+
+protected:
+	size_t m_channels;
+	BankChain *m_parent, *m_child, *m_simbling;
+
+	virtual const T* processFrame(const T* input) = 0;
+};
+
+// Buffer of frames, channel(c) reads one channel like a Buffer
+template<typename T>
+class BankBuffer :
+	public BankChain<T>
+{
+public:
+	typedef Buffer_T<T> trait;
+
+	// index 0 is the newest value of the channel
+	class Channel {
+	public:
+		Channel(const BankBuffer* bank, size_t channel) :
+			m_bank(bank),
+			m_channel(channel)
+		{
+
+		}
+
+		inline size_t size() const { return m_bank->size(); }
+		inline T out() const { return (*this)[0]; }
+		inline T operator[](size_t i) const {
+			return m_bank->frame(i)[m_channel];
+		}
+		inline T at(size_t i) const {
+			if (i >= size())
+				throw std::out_of_range("BankBuffer::Channel::at");
+			return (*this)[i];
+		}
+
+		inline T sample(fsize_t index, SampleType type = Linear) const {
+			index = std::max(index, static_cast<fsize_t>(0));
+			index = std::min(index, static_cast<fsize_t>(size() - 1));
+			size_t i0 = static_cast<size_t>(index);
+			size_t i1 = std::min(i0 + 1, size() - 1);
+			fsize_t ir = index - i0;
+			if (!trait::linear || type == Nearest)
+				return (ir < fsize_t(0.5)) ? (*this)[i0] : (*this)[i1];
+			return trait::mix((*this)[i0], (*this)[i1], ir);
+		}
+
+		inline void to(std::vector<T>& vector) const {
+			vector.resize(size());
+			for (size_t i = 0; i < size(); ++i)
+				vector[i] = (*this)[i];
+		}
+
+	protected:
+		const BankBuffer* m_bank;
+		size_t m_channel;
+	};
+
+	BankBuffer(size_t channels, size_t size, BankChain<T>* parent = nullptr) :
+		BankChain<T>(channels, parent),
+		m_data(channels * size, trait::zero),
+		m_size(size),
+		m_head(size - 1)
+	{
+		ASSERT(size > 1);
+	}
+
+	inline size_t size() const { return m_size; }
+
+	inline const T* out() const override { return frame(0); }
+
+	// all channels i frames ago, contiguous
+	inline const T* frame(size_t i) const {
+		size_t slot = (m_head >= i) ? m_head - i : m_head + m_size - i;
+		return m_data.data() + slot * this->m_channels;
+	}
+
+	inline Channel channel(size_t channel) const {
+		ASSERT(channel < this->m_channels);
+		return Channel(this, channel);
+	}
+
+	inline T at(size_t channel, size_t i) const { return this->channel(channel).at(i); }
+	inline T sample(size_t channel, fsize_t index, SampleType type = Linear) const {
+		return this->channel(channel).sample(index, type);
+	}
+
+	inline void fill(const T& value) {
+		std::fill(m_data.begin(), m_data.end(), value);
+	}
+
+protected:
+	std::vector<T> m_data; // frames oldest to newest, wrapping at m_head
+	size_t m_size, m_head;
+
+	inline const T* processFrame(const T* input) override {
+		m_head = (m_head + 1 == m_size) ? 0 : m_head + 1;
+		T* slot = m_data.data() + m_head * this->m_channels;
+		std::copy(input, input + this->m_channels, slot);
+		return slot;
+	}
+};
+
+// channels() identical filters of type Node run in lockstep, their state
+// kept per field across channels so every step is one loop over channels
+template<typename Node>
+class FilterBank;
+
+template<typename T>
+class FilterBankBase :
+	public BankChain<T>
+{
+public:
+	typedef Filter_T<T> trait;
+
+	FilterBankBase(size_t channels, const T& initial, BankChain<T>* parent) :
+		BankChain<T>(channels, parent),
+		m_out(channels, initial)
+	{
+
+	}
+
+	inline const T* out() const override { return m_out.data(); }
+
+protected:
+	std::vector<T> m_out;
+};
+
+template<typename T>
+class FilterBank<Limiter<T>> :
+	public FilterBankBase<T>
+{
+public:
+	FilterBank(size_t channels, BankChain<T>* parent = nullptr) :
+		FilterBankBase<T>(channels, FilterBank::trait::zero, parent),
+		m_low(channels, FilterBank::trait::zero),
+		m_high(channels, FilterBank::trait::unit)
+	{
+
+	}
+
+	inline void setLimit(const T& low, const T& high) {
+		std::fill(m_low.begin(), m_low.end(), low);
+		std::fill(m_high.begin(), m_high.end(), high);
+	}
+
+	inline void setLimit(size_t channel, const T& low, const T& high) {
+		m_low[channel] = low;
+		m_high[channel] = high;
+	}
+
+protected:
+	std::vector<T> m_low, m_high;
+
+	inline const T* processFrame(const T* input) override {
+		T* output = this->m_out.data();
+		const T* low = m_low.data();
+		const T* high = m_high.data();
+		for (size_t c = 0; c < this->m_channels; ++c)
+			output[c] = (input[c] < low[c]) ? low[c] : (input[c] > high[c]) ? high[c] : input[c];
+		return output;
+	}
+};
+
+template<typename T>
+class FilterBank<Comparator<T>> :
+	public FilterBankBase<T>
+{
+public:
+	FilterBank(size_t channels, const T& initial = Filter_T<T>::zero,
+		BankChain<T>* parent = nullptr) :
+		FilterBankBase<T>(channels, initial, parent),
+		m_low(channels, FilterBank::trait::zero),
+		m_high(channels, FilterBank::trait::zero)
+	{
+
+	}
+
+	inline void setThreshold(const T& threshold) {
+		setThreshold(threshold, threshold);
+	}
+
+	inline void setThreshold(const T& low, const T& high) {
+		std::fill(m_low.begin(), m_low.end(), low);
+		std::fill(m_high.begin(), m_high.end(), high);
+	}
+
+	inline void setThreshold(size_t channel, const T& low, const T& high) {
+		m_low[channel] = low;
+		m_high[channel] = high;
+	}
+
+protected:
+	std::vector<T> m_low, m_high;
+
+	inline const T* processFrame(const T* input) override {
+		T* output = this->m_out.data();
+		const T* low = m_low.data();
+		const T* high = m_high.data();
+		const T zero = FilterBank::trait::zero, unit = FilterBank::trait::unit;
+		for (size_t c = 0; c < this->m_channels; ++c)
+			output[c] = (input[c] < low[c]) ? zero : (input[c] > high[c]) ? unit : output[c];
+		return output;
+	}
+};
+
+template<typename T>
+class FilterBank<EMAFilter<T>> :
+	public FilterBankBase<T>
+{
+public:
+	FilterBank(size_t channels, fsize_t alpha = fsize_t(0.1),
+		BankChain<T>* parent = nullptr) :
+		FilterBankBase<T>(channels, FilterBank::trait::zero, parent),
+		m_alpha(alpha)
+	{
+
+	}
+
+	inline fsize_t alpha() const { return m_alpha; }
+	inline void setAlpha(fsize_t alpha) {
+		m_alpha = alpha;
+	}
+
+protected:
+	fsize_t m_alpha;
+
+	inline const T* processFrame(const T* input) override {
+		T* output = this->m_out.data();
+		const fsize_t alpha = m_alpha;
+		for (size_t c = 0; c < this->m_channels; ++c)
+			output[c] = Buffer_T<T>::mix(output[c], input[c], alpha);
+		return output;
+	}
+};
+
+// extreme of the last size frames per channel by van Herk/Gil-Werman:
+// the window is a suffix of the previous block of size frames and a
+// prefix of the current one, both kept per channel, so every channel
+// takes the same branch free steps
+template<typename T, typename Compare>
+class SlidingExtremeBank {
+public:
+	SlidingExtremeBank(size_t channels, size_t size, const T& initial) :
+		m_channels(channels),
+		m_size(size),
+		m_pos(0),
+		m_values(channels * size, initial),
+		m_suffix(channels * size, initial),
+		m_prefix(channels, initial)
+	{
+		ASSERT(size > 0);
+	}
+
+	inline size_t size() const { return m_size; }
+
+	inline void push(const T* input, T* output) {
+		const size_t n = m_channels;
+		T* prefix = m_prefix.data();
+		T* values = m_values.data() + m_pos * n;
+		std::copy(input, input + n, values);
+		if (m_pos == 0)
+			std::copy(input, input + n, prefix);
+		else
+			for (size_t c = 0; c < n; ++c)
+				prefix[c] = select(prefix[c], input[c]);
+
+		if (m_pos + 1 < m_size) {
+			const T* suffix = m_suffix.data() + (m_pos + 1) * n;
+			for (size_t c = 0; c < n; ++c)
+				output[c] = select(suffix[c], prefix[c]);
+			++m_pos;
+		} else {
+			std::copy(prefix, prefix + n, output);
+			complete();
+			m_pos = 0;
+		}
+	}
+
+protected:
+	size_t m_channels, m_size, m_pos;
+	// frames of the current block and suffix extremes of the previous one
+	std::vector<T> m_values, m_suffix;
+	std::vector<T> m_prefix;
+	Compare m_compare;
+
+	inline T select(const T& a, const T& b) const {
+		return m_compare(a, b) ? a : b;
+	}
+
+	inline void complete() {
+		const size_t n = m_channels;
+		T* suffix = m_suffix.data();
+		const T* values = m_values.data();
+		std::copy(values + (m_size - 1) * n, values + m_size * n, suffix + (m_size - 1) * n);
+		for (size_t k = m_size - 1; k-- > 0;) {
+			for (size_t c = 0; c < n; ++c)
+				suffix[k * n + c] = select(values[k * n + c], suffix[(k + 1) * n + c]);
+		}
+	}
+};
+
+template<typename T, size_t N>
+class FilterBank<HoldHigh<T, N>> :
+	public FilterBankBase<T>
+{
+public:
+	// a nonzero N has to be matched by size, see windowSize()
+	FilterBank(size_t channels, size_t size, BankChain<T>* parent = nullptr) :
+		FilterBankBase<T>(channels, FilterBank::trait::zero, parent),
+		m_extreme(channels, windowSize<N>(size), FilterBank::trait::zero)
+	{
+
+	}
+
+	explicit FilterBank(size_t channels, BankChain<T>* parent = nullptr) :
+		FilterBankBase<T>(channels, FilterBank::trait::zero, parent),
+		m_extreme(channels, N, FilterBank::trait::zero)
+	{
+		static_assert(N > 0, "window size missing");
+	}
+
+protected:
+	SlidingExtremeBank<T, std::greater<T>> m_extreme;
+
+	inline const T* processFrame(const T* input) override {
+		m_extreme.push(input, this->m_out.data());
+		return this->m_out.data();
+	}
+};
+
+template<typename T, size_t N>
+class FilterBank<HoldLow<T, N>> :
+	public FilterBankBase<T>
+{
+public:
+	// a nonzero N has to be matched by size, see windowSize()
+	FilterBank(size_t channels, size_t size, BankChain<T>* parent = nullptr) :
+		FilterBankBase<T>(channels, FilterBank::trait::zero, parent),
+		m_extreme(channels, windowSize<N>(size), FilterBank::trait::zero)
+	{
+
+	}
+
+	explicit FilterBank(size_t channels, BankChain<T>* parent = nullptr) :
+		FilterBankBase<T>(channels, FilterBank::trait::zero, parent),
+		m_extreme(channels, N, FilterBank::trait::zero)
+	{
+		static_assert(N > 0, "window size missing");
+	}
+
+protected:
+	SlidingExtremeBank<T, std::less<T>> m_extreme;
+
+	inline const T* processFrame(const T* input) override {
+		m_extreme.push(input, this->m_out.data());
+		return this->m_out.data();
+	}
+};
+
+// biquad cascade shared by all channels, state per section and channel
+template<typename T>
+class FilterBank<IIRFilter<T>> :
+	public FilterBankBase<T>
+{
+public:
+	FilterBank(size_t channels, size_t sections, BankChain<T>* parent = nullptr) :
+		FilterBankBase<T>(channels, FilterBank::trait::zero, parent),
+		m_prototype(sections),
+		m_z1(sections * channels, FilterBank::trait::zero),
+		m_z2(sections * channels, FilterBank::trait::zero)
+	{
+
+	}
+
+	inline size_t sections() const { return m_prototype.sections(); }
+
+	inline void setSection(size_t i, T b0, T b1, T b2, T a0, T a1, T a2) {
+		m_prototype.setSection(i, b0, b1, b2, a0, a1, a2);
+	}
+
+	inline void setButterworthLowpass(double cutoff) {
+		m_prototype.setButterworthLowpass(cutoff);
+	}
+
+	inline void reset() {
+		std::fill(m_z1.begin(), m_z1.end(), FilterBank::trait::zero);
+		std::fill(m_z2.begin(), m_z2.end(), FilterBank::trait::zero);
+	}
+
+protected:
+	// only the coefficients are used, reached through Coefficients
+	struct Coefficients : IIRFilter<T> {
+		using IIRFilter<T>::IIRFilter;
+		using IIRFilter<T>::m_b0;
+		using IIRFilter<T>::m_b1;
+		using IIRFilter<T>::m_b2;
+		using IIRFilter<T>::m_a1;
+		using IIRFilter<T>::m_a2;
+	};
+
+	Coefficients m_prototype;
+	std::vector<T> m_z1, m_z2;
+
+	inline const T* processFrame(const T* input) override {
+		const size_t n = this->m_channels;
+		T* output = this->m_out.data();
+		std::copy(input, input + n, output);
+		for (size_t s = 0; s < sections(); ++s) {
+			const T b0 = m_prototype.m_b0[s], b1 = m_prototype.m_b1[s];
+			const T b2 = m_prototype.m_b2[s];
+			const T a1 = m_prototype.m_a1[s], a2 = m_prototype.m_a2[s];
+			T* z1 = m_z1.data() + s * n;
+			T* z2 = m_z2.data() + s * n;
+			for (size_t c = 0; c < n; ++c) {
+				const T x = output[c];
+				const T y = b0 * x + z1[c];
+				z1[c] = b1 * x - a1 * y + z2[c];
+				z2[c] = b2 * x - a2 * y;
+				output[c] = y;
+			}
+		}
+		return output;
+	}
+};
+
+}
+
+#endif // FILTERBANK_H
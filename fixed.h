@@ -0,0 +1,154 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <ostream>
+
+namespace FilterLib {
+
+// signed fixed point, the low Frac bits of Raw below the binary point.
+// Arithmetic rounds to nearest and saturates at the ends of Raw instead
+// of wrapping, Wide holds the product of two raw values
+template<typename Raw, typename Wide, int Frac>
+class Fixed {
+public:
+	static_assert(std::numeric_limits<Raw>::is_signed && Frac > 0 &&
+		Frac < std::numeric_limits<Raw>::digits + 1, "Fixed needs a signed Raw");
+	static_assert(sizeof(Wide) >= 2 * sizeof(Raw), "Wide holds no product");
+
+	typedef Raw RawType;
+	static constexpr int fraction = Frac;
+
+	constexpr Fixed() : m_raw(0) { }
+	explicit Fixed(double value) : m_raw(fromReal(value)) { }
+
+	static constexpr Fixed fromRaw(Raw raw) { return Fixed(raw, 0); }
+	static constexpr Fixed highest() { return fromRaw(std::numeric_limits<Raw>::max()); }
+	static constexpr Fixed lowest() { return fromRaw(std::numeric_limits<Raw>::min()); }
+
+	constexpr Raw raw() const { return m_raw; }
+
+	// the only conversion, float or an integer take it in two steps
+	explicit operator double() const { return double(m_raw) / double(one); }
+
+	inline Fixed operator-() const { return fromRaw(saturate(-Wide(m_raw))); }
+
+	inline Fixed& operator+=(Fixed b) { return *this = *this + b; }
+	inline Fixed& operator-=(Fixed b) { return *this = *this - b; }
+	inline Fixed& operator*=(Fixed b) { return *this = *this * b; }
+	inline Fixed& operator/=(Fixed b) { return *this = *this / b; }
+
+	friend inline Fixed operator+(Fixed a, Fixed b) {
+		return fromRaw(saturate(Wide(a.m_raw) + Wide(b.m_raw)));
+	}
+
+	friend inline Fixed operator-(Fixed a, Fixed b) {
+		return fromRaw(saturate(Wide(a.m_raw) - Wide(b.m_raw)));
+	}
+
+	friend inline Fixed operator*(Fixed a, Fixed b) {
+		return fromRaw(saturate((Wide(a.m_raw) * b.m_raw + (one >> 1)) >> Frac));
+	}
+
+	// truncates, a division by zero saturates towards the sign of a
+	friend inline Fixed operator/(Fixed a, Fixed b) {
+		if (b.m_raw == 0)
+			return (a.m_raw < 0) ? lowest() : highest();
+		return fromRaw(saturate(Wide(a.m_raw) * one / b.m_raw));
+	}
+
+	friend constexpr bool operator==(Fixed a, Fixed b) { return a.m_raw == b.m_raw; }
+	friend constexpr bool operator!=(Fixed a, Fixed b) { return a.m_raw != b.m_raw; }
+	friend constexpr bool operator<(Fixed a, Fixed b) { return a.m_raw < b.m_raw; }
+	friend constexpr bool operator>(Fixed a, Fixed b) { return a.m_raw > b.m_raw; }
+	friend constexpr bool operator<=(Fixed a, Fixed b) { return a.m_raw <= b.m_raw; }
+	friend constexpr bool operator>=(Fixed a, Fixed b) { return a.m_raw >= b.m_raw; }
+
+	// a + (b - a) * u, between a and b for u in [0, 1] so it never
+	// saturates. Double keeps the difference of two Q31 exact, halves
+	// round to even as the vector kernels do
+	static inline Fixed mix(Fixed a, Fixed b, float u) {
+		double step = double(Wide(b.m_raw) - Wide(a.m_raw)) * double(u);
+		return fromRaw(Raw(Wide(a.m_raw) + Wide(std::llrint(step))));
+	}
+
+	// sum of products rounded once at the end. Wide types drop the low
+	// bits of every product first so 2^16 of them fit in 64 bits
+	static inline Fixed dot(const Fixed* a, const Fixed* b, std::size_t n) {
+		const int drop = (2 * Frac + 17 > 63) ? 2 * Frac + 17 - 63 : 0;
+		const int shift = Frac - drop;
+		int64_t sum = 0;
+		for (std::size_t i = 0; i < n; ++i)
+			sum += (int64_t(a[i].m_raw) * b[i].m_raw) >> drop;
+		sum = (sum + (int64_t(1) << (shift - 1))) >> shift;
+		const int64_t high = std::numeric_limits<Raw>::max(), low = std::numeric_limits<Raw>::min();
+		return fromRaw(Raw((sum > high) ? high : (sum < low) ? low : sum));
+	}
+
+protected:
+	static constexpr Wide one = Wide(1) << Frac;
+
+	Raw m_raw;
+
+	constexpr Fixed(Raw raw, int) : m_raw(raw) { }
+
+	static constexpr Raw saturate(Wide value) {
+		return (value > Wide(std::numeric_limits<Raw>::max())) ? std::numeric_limits<Raw>::max() :
+			(value < Wide(std::numeric_limits<Raw>::min())) ? std::numeric_limits<Raw>::min() :
+			Raw(value);
+	}
+
+	// NaN reads as zero
+	static inline Raw fromReal(double value) {
+		double scaled = std::round(value * double(one));
+		if (!(scaled == scaled))
+			return 0;
+		if (scaled >= double(std::numeric_limits<Raw>::max()))
+			return std::numeric_limits<Raw>::max();
+		if (scaled <= double(std::numeric_limits<Raw>::min()))
+			return std::numeric_limits<Raw>::min();
+		return Raw(scaled);
+	}
+};
+
+template<typename Raw, typename Wide, int Frac>
+constexpr int Fixed<Raw, Wide, Frac>::fraction;
+template<typename Raw, typename Wide, int Frac>
+constexpr Wide Fixed<Raw, Wide, Frac>::one;
+
+// [-1, 1) in 16 and 32 bits
+typedef Fixed<int16_t, int32_t, 15> Q15;
+typedef Fixed<int32_t, int64_t, 31> Q31;
+
+template<typename Raw, typename Wide, int Frac>
+std::ostream& operator<<(std::ostream& a, const Fixed<Raw, Wide, Frac>& b) {
+	return a << double(b);
+}
+
+}
+
+namespace std {
+
+template<typename Raw, typename Wide, int Frac>
+class numeric_limits<FilterLib::Fixed<Raw, Wide, Frac>> {
+	typedef FilterLib::Fixed<Raw, Wide, Frac> F;
+public:
+	static constexpr bool is_specialized = true;
+	static constexpr bool is_signed = true;
+	static constexpr bool is_integer = false;
+	static constexpr bool is_exact = true;
+	static constexpr bool is_bounded = true;
+	static constexpr int radix = 2;
+	static constexpr int digits = numeric_limits<Raw>::digits;
+	static constexpr F min() { return F::fromRaw(1); }
+	static constexpr F lowest() { return F::lowest(); }
+	static constexpr F max() { return F::highest(); }
+	static constexpr F epsilon() { return F::fromRaw(1); }
+};
+
+}
+
+#endif // FIXED_H
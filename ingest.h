@@ -0,0 +1,217 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include "buffer.h"
+
+#include <atomic>
+#include <queue>
+
+namespace FilterLib {
+
+// bounded lock-free queue for many producers and one consumer, every
+// cell carries a sequence number telling whose turn it is (Vyukov)
+template<typename E>
+class MpscQueue {
+public:
+	explicit MpscQueue(size_t capacity) :
+		m_cells(roundUp(capacity)),
+		m_mask(m_cells.size() - 1),
+		m_tail(0),
+		m_head(0)
+	{
+		for (size_t i = 0; i < m_cells.size(); ++i)
+			m_cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	inline size_t capacity() const { return m_cells.size(); }
+
+	// any thread, false when full
+	inline bool push(const E& value) {
+		size_t pos = m_tail.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = m_cells[pos & m_mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			std::ptrdiff_t diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(pos);
+			if (diff == 0) {
+				if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+		Cell& cell = m_cells[pos & m_mask];
+		cell.value = value;
+		cell.sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer thread only, false when empty
+	inline bool pop(E& value) {
+		Cell& cell = m_cells[m_head & m_mask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		if (sequence != m_head + 1)
+			return false;
+		value = cell.value;
+		cell.sequence.store(m_head + m_cells.size(), std::memory_order_release);
+		++m_head;
+		return true;
+	}
+
+protected:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		E value;
+	};
+
+	std::vector<Cell> m_cells;
+	size_t m_mask;
+	// producers and the consumer on separate cache lines
+	alignas(64) std::atomic<size_t> m_tail;
+	alignas(64) size_t m_head;
+
+	static inline size_t roundUp(size_t capacity) {
+		size_t size = 2;
+		while (size < capacity)
+			size <<= 1;
+		return size;
+	}
+};
+
+// (time, value) samples from any thread into a time Buffer and the
+// value chain of its NuBuffers. poll() on the pipeline thread keeps
+// samples until they are lateness() older than the newest time seen,
+// then commits them in time order as one block to both. Samples older
+// than what was committed already are late: counted and dropped
+template<typename T>
+class Ingest {
+public:
+	Ingest(Buffer<time_t>* timeRef, ProcessChain<T>* input,
+		time_t lateness, size_t capacity = 4096) :
+		m_timeRef(timeRef),
+		m_input(input),
+		m_lateness(lateness),
+		m_queue(capacity),
+		m_sequence(0),
+		m_newest(0),
+		m_committed(0),
+		m_started(false),
+		m_released(false),
+		m_late(0),
+		m_dropped(0)
+	{
+		ASSERT(timeRef != nullptr && input != nullptr);
+		reserve(capacity);
+	}
+
+	// room for up to samples waiting in the reorder window; the blocks
+	// poll() commits are no longer, prepare() the graphs for that too
+	inline void reserve(size_t samples) {
+		m_heap.reserve(samples);
+		m_times.reserve(samples);
+		m_values.reserve(samples);
+	}
+
+	inline time_t lateness() const { return m_lateness; }
+	inline void setLateness(time_t lateness) {
+		m_lateness = lateness;
+	}
+
+	// samples arriving behind the committed time
+	inline size_t late() const { return m_late; }
+	// pushes refused by a full queue
+	inline size_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+	// samples waiting in the reorder window
+	inline size_t pending() const { return m_heap.size(); }
+
+	// any thread
+	inline bool push(time_t time, const T& value) {
+		if (m_queue.push(TimeValuePair<T>(time, value)))
+			return true;
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	// pipeline thread, returns the number of committed samples
+	inline size_t poll() {
+		drain();
+		if (m_heap.empty() || !m_started)
+			return 0;
+		return release(m_newest - m_lateness);
+	}
+
+	// commits everything still in the window
+	inline size_t flush() {
+		drain();
+		if (m_heap.empty())
+			return 0;
+		return release(m_newest);
+	}
+
+protected:
+	struct Entry {
+		time_t time;
+		size_t sequence; // arrival order among equal times
+		T value;
+
+		inline bool operator>(const Entry& other) const {
+			return (time != other.time) ? time > other.time : sequence > other.sequence;
+		}
+	};
+
+	Buffer<time_t>* m_timeRef;
+	ProcessChain<T>* m_input;
+	time_t m_lateness;
+	MpscQueue<TimeValuePair<T>> m_queue;
+	// reserve() reaches the container
+	struct Heap :
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>>
+	{
+		inline void reserve(size_t n) { this->c.reserve(n); }
+	};
+
+	Heap m_heap;
+	std::vector<time_t> m_times;
+	std::vector<T> m_values;
+	size_t m_sequence;
+	time_t m_newest, m_committed;
+	bool m_started, m_released;
+	size_t m_late;
+	std::atomic<size_t> m_dropped;
+
+	inline void drain() {
+		TimeValuePair<T> sample;
+		while (m_queue.pop(sample)) {
+			if (m_released && sample.first < m_committed) {
+				++m_late;
+				continue;
+			}
+			if (!m_started || sample.first > m_newest)
+				m_newest = sample.first;
+			m_started = true;
+			m_heap.push({ sample.first, m_sequence++, sample.second });
+		}
+	}
+
+	inline size_t release(time_t until) {
+		m_times.clear();
+		m_values.clear();
+		while (!m_heap.empty() && m_heap.top().time <= until) {
+			m_times.push_back(m_heap.top().time);
+			m_values.push_back(m_heap.top().value);
+			m_heap.pop();
+		}
+		if (m_times.empty())
+			return 0;
+		m_committed = m_times.back();
+		m_released = true;
+		m_timeRef->in(m_times.data(), m_times.size());
+		m_input->in(m_values.data(), m_values.size());
+		return m_times.size();
+	}
+};
+
+}
+
+#endif // INGEST_H
@@ -0,0 +1,321 @@
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include "buffer.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace FilterLib {
+
+// first page of a mapped buffer file, the ring starts on the next page
+struct MappedHeader {
+	static constexpr uint64_t signature = 0x314655424c544946; // "FILTBUF1"
+	static constexpr uint32_t revision = 1;
+
+	uint64_t magic;
+	uint32_t version;
+	uint32_t element; // elementTag<T>() of the values
+	uint64_t capacity;
+	RingState state;
+	char timeRef[256]; // file of the time buffer, empty when there is none
+};
+
+static_assert(sizeof(MappedHeader) <= 4096, "MappedHeader exceeds a page");
+
+// a file mapped shared: the header page followed by capacity values.
+// Everything written goes to the page cache right away, so the history is
+// there for the next run and for other processes mapping the same file,
+// sync() waits until it reached the disk
+class MappedFile {
+public:
+	enum Mode
+	{
+		ReadWrite = 0,
+		ReadOnly,
+	};
+
+	static constexpr size_t headerSize = 4096;
+
+	~MappedFile() {
+		if (m_header != nullptr)
+			munmap(m_header, m_length);
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	inline const std::string& path() const { return m_path; }
+	inline Mode mode() const { return m_mode; }
+	inline size_t capacity() const { return size_t(m_header->capacity); }
+	// false when the file already held a history
+	inline bool created() const { return m_created; }
+
+	inline std::string timeRefPath() const {
+		return std::string(m_header->timeRef,
+			strnlen(m_header->timeRef, sizeof(m_header->timeRef)));
+	}
+	inline void setTimeRefPath(const std::string& path) {
+		writable("setTimeRefPath");
+		if (path.size() >= sizeof(m_header->timeRef))
+			throw std::length_error("MappedFile::setTimeRefPath");
+		std::memset(m_header->timeRef, 0, sizeof(m_header->timeRef));
+		std::memcpy(m_header->timeRef, path.data(), path.size());
+	}
+
+	inline void sync() {
+		if (msync(m_header, m_length, MS_SYNC) != 0)
+			throw std::system_error(errno, std::generic_category(), "msync " + m_path);
+	}
+
+protected:
+	MappedHeader* m_header;
+	size_t m_length;
+	std::string m_path;
+	Mode m_mode;
+	bool m_created;
+
+	// capacity 0 takes whatever the file holds, which then has to exist
+	MappedFile(const std::string& path, size_t capacity, size_t elementSize,
+		uint32_t element, Mode mode) :
+		m_header(nullptr),
+		m_length(0),
+		m_path(path),
+		m_mode(mode),
+		m_created(false)
+	{
+		int fd = open(path.c_str(), (mode == ReadOnly) ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+		if (fd < 0)
+			fail("open", errno);
+		struct stat info;
+		if (fstat(fd, &info) != 0)
+			fail("fstat", errno, fd);
+
+		m_length = size_t(info.st_size);
+		if (m_length == 0 && mode == ReadWrite && capacity > 0) {
+			m_length = headerSize + capacity * elementSize;
+			if (ftruncate(fd, off_t(m_length)) != 0)
+				fail("ftruncate", errno, fd);
+			m_created = true;
+		}
+		if (m_length < headerSize) {
+			close(fd);
+			invalid("no buffer header");
+		}
+
+		int protection = (mode == ReadOnly) ? PROT_READ : PROT_READ | PROT_WRITE;
+		void* address = mmap(nullptr, m_length, protection, MAP_SHARED, fd, 0);
+		if (address == MAP_FAILED)
+			fail("mmap", errno, fd);
+		close(fd);
+		m_header = static_cast<MappedHeader*>(address);
+
+		if (m_created) {
+			m_header->magic = MappedHeader::signature;
+			m_header->version = MappedHeader::revision;
+			m_header->element = element;
+			m_header->capacity = capacity;
+			m_header->state.head = capacity - 1;
+			m_header->state.pushed = 0;
+			m_header->state.sequence.store(0, std::memory_order_relaxed);
+			return;
+		}
+		if (m_header->magic != MappedHeader::signature ||
+			m_header->version != MappedHeader::revision)
+			invalid("not a buffer file");
+		if (m_header->element != element)
+			invalid("element type differs");
+		if (capacity != 0 && m_header->capacity != capacity)
+			invalid("capacity differs");
+		if (m_length < headerSize + m_header->capacity * elementSize)
+			invalid("file is truncated");
+		// a writer died inside a push, the ring is as far as it got. Readers
+		// cannot repair that and would wait for the push forever, they give
+		// the writer some time to finish a push it is just doing
+		size_t sequence = m_header->state.sequence.load(std::memory_order_relaxed);
+		if (!(sequence & 1))
+			return;
+		if (mode == ReadWrite)
+			m_header->state.sequence.store(sequence + 1, std::memory_order_release);
+		else if (!settles(sequence))
+			invalid("writer died inside a push");
+	}
+
+	inline bool settles(size_t sequence) const {
+		for (int i = 0; i < 100; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			if (m_header->state.sequence.load(std::memory_order_acquire) != sequence)
+				return true;
+		}
+		return false;
+	}
+
+	// the read only mapping would fault on the first store
+	inline void writable(const char* call) const {
+		if (m_mode == ReadOnly)
+			throw std::logic_error(m_path + ": " + call + " on a read only buffer");
+	}
+
+	inline void* data() const {
+		return reinterpret_cast<char*>(m_header) + headerSize;
+	}
+
+	// only while constructing, before anything got mapped
+	inline void fail(const char* call, int error, int fd = -1) {
+		if (fd >= 0)
+			close(fd);
+		throw std::system_error(error, std::generic_category(),
+			std::string(call) + " " + m_path);
+	}
+
+	inline void invalid(const char* reason) {
+		if (m_header != nullptr)
+			munmap(m_header, m_length);
+		m_header = nullptr;
+		throw std::runtime_error(m_path + ": " + reason);
+	}
+};
+
+// Buffer with its ring in a MappedFile: pushes go straight into the
+// mapping and the ring continues where it stopped when the same file is
+// opened again. The read only variant views a buffer another process
+// writes without copying, snapshot() gives it consistent reads; pushing
+// into it throws std::logic_error
+template<typename T>
+class MappedBuffer :
+	public MappedFile,
+	public Buffer<T>
+{
+public:
+	static_assert(std::is_trivially_copyable<T>::value,
+		"MappedBuffer needs trivially copyable values");
+
+	MappedBuffer(const std::string& path, size_t size,
+		ProcessChain<T>* parent = nullptr) :
+		MappedFile(path, size, sizeof(T), elementTag<T>(), ReadWrite),
+		Buffer<T>(static_cast<T*>(data()), size, &m_header->state, parent)
+	{
+		if (m_created)
+			std::fill(this->m_data.begin(), this->m_data.end(), Buffer<T>::trait::zero);
+	}
+
+	explicit MappedBuffer(const std::string& path) :
+		MappedFile(path, 0, sizeof(T), elementTag<T>(), ReadOnly),
+		Buffer<T>(static_cast<T*>(data()), MappedFile::capacity(), &m_header->state, nullptr)
+	{
+
+	}
+
+	virtual inline std::string name() const override {
+		return this->m_name.empty() ? "MappedBuffer" : this->m_name;
+	}
+
+	inline void push(const T& value) {
+		writable("push");
+		Buffer<T>::push(value);
+	}
+
+	inline void push(const T* values, size_t n) {
+		writable("push");
+		Buffer<T>::push(values, n);
+	}
+
+	inline void fill(const T& value) override {
+		writable("fill");
+		Buffer<T>::fill(value);
+	}
+
+	// the ring stays in the mapping
+	void relocate(Arena&) override { }
+
+protected:
+	inline T process(const T& input) override {
+		writable("in");
+		return Buffer<T>::process(input);
+	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		writable("in");
+		return Buffer<T>::processBlock(input, n);
+	}
+};
+
+// NuBuffer with its values mapped, the header links the file of its time
+// reference so a reader finds both
+template<typename T>
+class MappedNuBuffer :
+	public MappedFile,
+	public NuBuffer<T>
+{
+public:
+	static_assert(std::is_trivially_copyable<T>::value,
+		"MappedNuBuffer needs trivially copyable values");
+
+	MappedNuBuffer(const std::string& path, size_t size,
+		MappedBuffer<time_t>* timeRef,
+		ProcessChain<T>* parent = nullptr) :
+		MappedFile(path, size, sizeof(T), elementTag<T>(), ReadWrite),
+		NuBuffer<T>(static_cast<T*>(data()), size, &m_header->state, timeRef, parent)
+	{
+		if (m_created)
+			std::fill(this->m_data.begin(), this->m_data.end(), NuBuffer<T>::trait::zero);
+		setTimeRefPath(timeRef->path());
+	}
+
+	// timeRef is usually MappedBuffer<time_t>(timeRefPath()) read only
+	MappedNuBuffer(const std::string& path, Buffer<time_t>* timeRef) :
+		MappedFile(path, 0, sizeof(T), elementTag<T>(), ReadOnly),
+		NuBuffer<T>(static_cast<T*>(data()), MappedFile::capacity(), &m_header->state,
+			timeRef, nullptr)
+	{
+
+	}
+
+	virtual inline std::string name() const override {
+		return this->m_name.empty() ? "MappedNuBuffer" : this->m_name;
+	}
+
+	inline void push(const T& value) {
+		writable("push");
+		NuBuffer<T>::push(value);
+	}
+
+	inline void push(const T* values, size_t n) {
+		writable("push");
+		NuBuffer<T>::push(values, n);
+	}
+
+	inline void fill(const T& value) override {
+		writable("fill");
+		NuBuffer<T>::fill(value);
+	}
+
+	// the ring stays in the mapping
+	void relocate(Arena&) override { }
+
+protected:
+	inline T process(const T& input) override {
+		writable("in");
+		return NuBuffer<T>::process(input);
+	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		writable("in");
+		return NuBuffer<T>::processBlock(input, n);
+	}
+};
+
+}
+
+#endif // MAPPED_H
@@ -0,0 +1,294 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "buffer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace FilterLib {
+
+// fixed set of workers, each with its own task deque: owners pop the
+// newest task, idle workers steal the oldest one from the others. The
+// thread calling run() works along until its batch is done. Task storage
+// is kept between batches, once it held the largest batch run() does not
+// allocate
+class WorkStealingPool {
+public:
+	explicit WorkStealingPool(size_t workers = defaultWorkers()) :
+		m_queues(workers + 1),
+		m_pending(0),
+		m_next(0),
+		m_stop(false)
+	{
+		for (size_t i = 0; i < workers; ++i)
+			m_workers.emplace_back(&WorkStealingPool::work, this, i + 1);
+	}
+
+	~WorkStealingPool() {
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		for (auto& worker : m_workers)
+			worker.join();
+	}
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	static size_t defaultWorkers() {
+		size_t threads = std::thread::hardware_concurrency();
+		return (threads > 1) ? threads - 1 : 0;
+	}
+
+	inline size_t workers() const { return m_workers.size(); }
+
+	// room for batches of up to count tasks
+	inline void reserve(size_t count) {
+		for (Queue& queue : m_queues) {
+			std::lock_guard<std::mutex> lock(queue.lock);
+			queue.tasks.reserve(count);
+		}
+	}
+
+	// body(i) for i in [0, count), returns once all of them returned
+	template<typename Body>
+	void run(size_t count, Body& body) {
+		if (count == 0)
+			return;
+		if (m_workers.empty() || count == 1) {
+			for (size_t i = 0; i < count; ++i)
+				body(i);
+			return;
+		}
+
+		Batch batch;
+		batch.context = &body;
+		batch.call = [](void* context, size_t i) { (*static_cast<Body*>(context))(i); };
+		batch.remaining = count;
+		// counted before any task can be claimed, so m_pending never drops
+		// below the number of queued tasks
+		m_pending.fetch_add(count, std::memory_order_release);
+		for (size_t i = 0; i < count; ++i) {
+			Queue& queue = m_queues[(m_next++) % m_queues.size()];
+			std::lock_guard<std::mutex> lock(queue.lock);
+			queue.tasks.push_back({ &batch, i });
+		}
+		// a worker between its check of m_pending and its wait holds
+		// m_lock, taking it here makes sure the notify reaches it
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+		}
+		m_wake.notify_all();
+
+		Task task;
+		while (batch.remaining.load(std::memory_order_acquire) > 0) {
+			if (take(0, task))
+				execute(task);
+			else
+				std::this_thread::yield();
+		}
+	}
+
+protected:
+	struct Batch {
+		void* context;
+		void (*call)(void*, size_t);
+		std::atomic<size_t> remaining;
+	};
+
+	struct Task {
+		Batch* batch;
+		size_t index;
+	};
+
+	// a deque over a vector that only grows: stolen tasks leave a gap at
+	// the front until the queue runs empty
+	struct Queue {
+		std::mutex lock;
+		std::vector<Task> tasks;
+		size_t first = 0;
+
+		inline bool empty() const { return first == tasks.size(); }
+		inline void settle() {
+			if (empty()) {
+				tasks.clear();
+				first = 0;
+			}
+		}
+	};
+
+	// queue 0 belongs to the threads calling run()
+	std::deque<Queue> m_queues;
+	std::vector<std::thread> m_workers;
+	// m_lock only guards sleeping and m_stop, claims never take it
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::atomic<size_t> m_pending;
+	std::atomic<size_t> m_next;
+	bool m_stop;
+
+	inline bool take(size_t self, Task& task) {
+		{
+			Queue& own = m_queues[self];
+			std::lock_guard<std::mutex> lock(own.lock);
+			if (!own.empty()) {
+				task = own.tasks.back();
+				own.tasks.pop_back();
+				own.settle();
+				return claimed();
+			}
+		}
+		for (size_t i = 1; i < m_queues.size(); ++i) {
+			Queue& other = m_queues[(self + i) % m_queues.size()];
+			std::lock_guard<std::mutex> lock(other.lock);
+			if (!other.empty()) {
+				task = other.tasks[other.first++];
+				other.settle();
+				return claimed();
+			}
+		}
+		return false;
+	}
+
+	inline bool claimed() {
+		m_pending.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	static inline void execute(const Task& task) {
+		task.batch->call(task.batch->context, task.index);
+		task.batch->remaining.fetch_sub(1, std::memory_order_release);
+	}
+
+	void work(size_t self) {
+		Task task;
+		for (;;) {
+			if (take(self, task)) {
+				execute(task);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_wake.wait(lock, [this] {
+				return m_stop || m_pending.load(std::memory_order_acquire) > 0;
+			});
+			if (m_stop)
+				return;
+		}
+	}
+};
+
+// block mode ProcessChain::in with the branches below root run on a pool:
+// every simbling of root with its subtree gets the input block, every
+// child of root with its subtree the output block of root. Branches only
+// touch their own nodes and read the shared blocks, so the result is the
+// same as the serial call. Below threshold() samples times nodes in the
+// branches all of it stays on the calling thread
+template<typename T>
+class ParallelExecutor {
+public:
+	static constexpr size_t defaultThreshold = 1 << 14;
+
+	ParallelExecutor(ProcessChain<T>* root, WorkStealingPool& pool,
+		size_t threshold = defaultThreshold) :
+		m_root(root),
+		m_pool(pool),
+		m_threshold(threshold),
+		m_revision(0),
+		m_nodes(0)
+	{
+		ASSERT(root != nullptr);
+	}
+
+	inline ProcessChain<T>* root() const { return m_root; }
+	inline size_t threshold() const { return m_threshold; }
+	inline void setThreshold(size_t threshold) {
+		m_threshold = threshold;
+	}
+
+	// ProcessChain::prepare() of the graph plus room for its branches in
+	// the pool, in() then does not allocate until the graph changes
+	inline void prepare(size_t n) {
+		collect();
+		m_root->prepare(n);
+		m_pool.reserve(m_branches.size());
+	}
+
+	inline T in(const T& input) {
+		return m_root->in(input);
+	}
+
+	inline const T* in(const T* input, size_t n) {
+		if (m_revision != topologyRevision())
+			collect();
+		if (n * m_nodes < m_threshold || m_branches.size() < 2)
+			return m_root->in(input, n);
+
+		const T* output = m_root->runBlock(input, n);
+		auto body = [&](size_t i) {
+			const Branch& branch = m_branches[i];
+			run(branch.node, branch.child ? output : input, n);
+		};
+		m_pool.run(m_branches.size(), body);
+		if (n > 0)
+			m_root->commit(output[n - 1]);
+		return output;
+	}
+
+protected:
+	struct Branch {
+		ProcessChain<T>* node;
+		bool child; // fed by root's output rather than its input
+	};
+
+	ProcessChain<T>* m_root;
+	WorkStealingPool& m_pool;
+	size_t m_threshold, m_revision, m_nodes;
+	std::vector<Branch> m_branches;
+
+	// node and its children, without its simblings
+	static inline void run(ProcessChain<T>* node, const T* input, size_t n) {
+		const T* output = node->runBlock(input, n);
+		if (node->m_child != nullptr)
+			node->m_child->in(output, n);
+		if (n > 0)
+			node->commit(output[n - 1]);
+	}
+
+	static inline size_t count(const ProcessChain<T>* node) {
+		size_t nodes = 0;
+		std::vector<const ProcessChain<T>*> stack(1, node);
+		while (!stack.empty()) {
+			node = stack.back();
+			stack.pop_back();
+			++nodes;
+			for (auto child = node->first(); child != nullptr; child = child->next())
+				stack.push_back(child);
+		}
+		return nodes;
+	}
+
+	inline void collect() {
+		m_branches.clear();
+		m_nodes = 0;
+		for (auto node = m_root->next(); node != nullptr; node = node->next())
+			m_branches.push_back({ node, false });
+		for (auto node = m_root->first(); node != nullptr; node = node->next())
+			m_branches.push_back({ node, true });
+		for (auto& branch : m_branches)
+			m_nodes += count(branch.node);
+		m_revision = topologyRevision();
+	}
+};
+
+template<typename T>
+constexpr size_t ParallelExecutor<T>::defaultThreshold;
+
+}
+
+#endif // PARALLEL_H
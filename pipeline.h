@@ -0,0 +1,205 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "filter.h"
+
+#include <stdexcept>
+#include <type_traits>
+
+namespace FilterLib {
+
+// value type of a node, deduced from its ProcessChain base
+template<typename T>
+T chainValue(const ProcessChain<T>*);
+
+template<typename S>
+using ChainValue = decltype(chainValue(static_cast<S*>(nullptr)));
+
+// a node run by a Pipeline, process() and commit() are called qualified
+// so they bind statically and can be inlined into the caller
+template<typename S>
+class PipelineStage :
+	public S
+{
+public:
+	typedef ChainValue<S> T;
+
+	PipelineStage(const S& stage) :
+		S(checked(stage))
+	{
+
+	}
+
+	inline T run(const T& input) {
+		T output = S::process(input);
+		S::commit(output);
+		return output;
+	}
+
+	inline const T* run(const T* input, size_t n) {
+		const T* output = S::processBlock(input, n);
+		if (n > 0)
+			S::commit(output[n - 1]);
+		return output;
+	}
+
+protected:
+	// a node of another graph would be fed by both
+	static inline const S& checked(const S& stage) {
+		if (stage.parent() != nullptr)
+			throw std::invalid_argument("Pipeline: stage has a parent");
+		return stage;
+	}
+};
+
+template<typename... Stages>
+class PipelineStages;
+
+template<typename S>
+class PipelineStages<S> {
+public:
+	typedef ChainValue<S> T;
+
+	PipelineStages(const S& head = S()) :
+		m_head(head)
+	{
+
+	}
+
+	inline T run(const T& input) { return m_head.run(input); }
+	inline const T* run(const T* input, size_t n) { return m_head.run(input, n); }
+	inline void reserve(size_t n) { m_head.reserve(n); }
+
+	template<typename B>
+	inline PipelineStages<S, B> append(const B& stage) const {
+		return PipelineStages<S, B>(m_head, PipelineStages<B>(stage));
+	}
+
+	PipelineStage<S> m_head;
+};
+
+template<typename S, typename... Rest>
+class PipelineStages<S, Rest...> {
+public:
+	typedef ChainValue<S> T;
+
+	static_assert(std::is_same<T, typename PipelineStages<Rest...>::T>::value,
+		"Pipeline stages need the same value type");
+
+	PipelineStages(const S& head = S(),
+		const PipelineStages<Rest...>& tail = PipelineStages<Rest...>()) :
+		m_head(head),
+		m_tail(tail)
+	{
+
+	}
+
+	inline T run(const T& input) { return m_tail.run(m_head.run(input)); }
+	inline const T* run(const T* input, size_t n) {
+		return m_tail.run(m_head.run(input, n), n);
+	}
+	inline void reserve(size_t n) {
+		m_head.reserve(n);
+		m_tail.reserve(n);
+	}
+
+	template<typename B>
+	inline PipelineStages<S, Rest..., B> append(const B& stage) const {
+		return PipelineStages<S, Rest..., B>(m_head, m_tail.append(stage));
+	}
+
+	PipelineStage<S> m_head;
+	PipelineStages<Rest...> m_tail;
+};
+
+template<size_t I, typename... Stages>
+struct PipelineAt;
+
+template<typename S, typename... Rest>
+struct PipelineAt<0, S, Rest...> {
+	typedef S type;
+	static inline S& get(PipelineStages<S, Rest...>& stages) { return stages.m_head; }
+};
+
+template<size_t I, typename S, typename... Rest>
+struct PipelineAt<I, S, Rest...> {
+	typedef typename PipelineAt<I - 1, Rest...>::type type;
+	static inline type& get(PipelineStages<S, Rest...>& stages) {
+		return PipelineAt<I - 1, Rest...>::get(stages.m_tail);
+	}
+};
+
+// Stages fused into one node: each input runs through all of them with no
+// virtual call in between. Outside it is a plain Filter, so dynamic nodes
+// feed it and hang off it as usual; stages themselves stay unparented and
+// are reached through stage<I>()
+template<typename... Stages>
+class Pipeline :
+	public Filter<typename PipelineStages<Stages...>::T>
+{
+public:
+	typedef typename PipelineStages<Stages...>::T T;
+
+	explicit Pipeline(ProcessChain<T>* parent = nullptr) :
+		Filter<T>(parent)
+	{
+
+	}
+
+	Pipeline(const Stages&... stages) :
+		Filter<T>(nullptr),
+		m_stages(PipelineStages<Stages...>(stages...))
+	{
+
+	}
+
+	explicit Pipeline(const PipelineStages<Stages...>& stages) :
+		Filter<T>(nullptr),
+		m_stages(stages)
+	{
+
+	}
+
+	static constexpr size_t size() { return sizeof...(Stages); }
+
+	template<size_t I>
+	inline typename PipelineAt<I, Stages...>::type& stage() {
+		return PipelineAt<I, Stages...>::get(m_stages);
+	}
+
+	inline const PipelineStages<Stages...>& stages() const { return m_stages; }
+
+	// the stages are not linked, so prepare() reaches them through here
+	void reserve(size_t n) override {
+		Filter<T>::reserve(n);
+		m_stages.reserve(n);
+	}
+
+protected:
+	PipelineStages<Stages...> m_stages;
+
+	inline T process(const T& input) override {
+		return m_stages.run(input);
+	}
+
+	inline const T* processBlock(const T* input, size_t n) override {
+		return m_stages.run(input, n);
+	}
+};
+
+// Limiter<float>() | Comparator<float>() | Buffer<float>(64), operands are
+// copied, a parented one throws std::invalid_argument
+template<typename A, typename B, typename std::enable_if<
+	std::is_same<ChainValue<A>, ChainValue<B>>::value, int>::type = 0>
+inline Pipeline<A, B> operator|(const A& a, const B& b) {
+	return Pipeline<A, B>(a, b);
+}
+
+template<typename... Stages, typename B>
+inline Pipeline<Stages..., B> operator|(const Pipeline<Stages...>& a, const B& b) {
+	return Pipeline<Stages..., B>(a.stages().append(b));
+}
+
+}
+
+#endif // PIPELINE_H
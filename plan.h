@@ -0,0 +1,137 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include "buffer.h"
+
+namespace FilterLib {
+
+// the graph under root flattened into the exact call order of
+// ProcessChain::in, run as one loop over steps instead of a recursion
+// through simblings and children. Every node writes its own slot and
+// reads the slot of its parent, slot 0 is the input. The plan compiles
+// itself again on the next in() once any node got linked anywhere
+template<typename T>
+class ExecutionPlan {
+public:
+	struct Step {
+		ProcessChain<T>* node;
+		size_t input, output;
+		bool commit; // commit(output) rather than process(input) into output
+	};
+
+	explicit ExecutionPlan(ProcessChain<T>* root) :
+		m_root(root),
+		m_revision(0)
+	{
+		ASSERT(root != nullptr);
+		compile();
+	}
+
+	inline ProcessChain<T>* root() const { return m_root; }
+	inline const std::vector<Step>& steps() const { return m_steps; }
+	inline size_t nodes() const { return m_values.size() - 1; }
+	inline bool stale() const { return m_revision != topologyRevision(); }
+
+	inline void compile() {
+		struct Pending {
+			ProcessChain<T>* node;
+			size_t slot;
+			bool commit;
+		};
+
+		m_steps.clear();
+		size_t slots = 1;
+		std::vector<Pending> stack(1, Pending{ m_root, 0, false });
+		while (!stack.empty()) {
+			Pending item = stack.back();
+			stack.pop_back();
+			if (item.commit) {
+				m_steps.push_back({ item.node, item.slot, item.slot, true });
+				continue;
+			}
+			size_t output = slots++;
+			m_steps.push_back({ item.node, item.slot, output, false });
+			// popped in reverse: simblings, then children, then the commit
+			stack.push_back({ item.node, output, true });
+			if (item.node->m_child != nullptr)
+				stack.push_back({ item.node->m_child, output, false });
+			if (item.node->m_simbling != nullptr)
+				stack.push_back({ item.node->m_simbling, item.slot, false });
+		}
+		m_values.assign(slots, T());
+		m_blocks.assign(slots, nullptr);
+		m_revision = topologyRevision();
+	}
+
+	// same as root()->in(input)
+	inline T in(const T& input) {
+		if (stale())
+			compile();
+		T* values = m_values.data();
+		values[0] = input;
+		for (const Step& step : m_steps) {
+			if (step.commit)
+				step.node->commit(values[step.output]);
+			else
+				values[step.output] = step.node->run(values[step.input]);
+		}
+		return values[1];
+	}
+
+	// same as root()->in(input, n)
+	inline const T* in(const T* input, size_t n) {
+		if (stale())
+			compile();
+		const T** blocks = m_blocks.data();
+		blocks[0] = input;
+		for (const Step& step : m_steps) {
+			if (step.commit) {
+				if (n > 0)
+					step.node->commit(blocks[step.output][n - 1]);
+			} else {
+				blocks[step.output] = step.node->runBlock(blocks[step.input], n);
+			}
+		}
+		return blocks[1];
+	}
+
+protected:
+	ProcessChain<T>* m_root;
+	size_t m_revision;
+	std::vector<Step> m_steps;
+	std::vector<T> m_values;
+	std::vector<const T*> m_blocks;
+};
+
+// compiled order, one step per line, with costs every process step's
+// share of what the whole plan spent
+template<typename T>
+std::string trace(const ExecutionPlan<T>& plan, bool costs = false) {
+	std::stringstream ss;
+	uint64_t total = 0;
+	for (auto& step : plan.steps())
+		total += (costs && !step.commit) ? step.node->profile().total : 0;
+	if (plan.stale())
+		ss << "(stale)" << std::endl;
+	size_t index = 0;
+	for (auto& step : plan.steps()) {
+		auto buffer = dynamic_cast<const Buffer<T>*>(step.node);
+		std::stringstream name;
+		if (buffer != nullptr)
+			name << buffer->name() << "[" << buffer->size() << "]";
+		else
+			name << "Filter@" << step.node;
+		ss << std::setw(4) << index++ << ' ';
+		if (step.commit)
+			ss << "commit  " << name.str() << " #" << step.output;
+		else
+			ss << "process " << name.str() << " #" << step.input << " -> #" << step.output
+				<< profileShare(step.node, total);
+		ss << std::endl;
+	}
+	return ss.str();
+}
+
+}
+
+#endif // PLAN_H
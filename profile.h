@@ -0,0 +1,134 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "buffer.h"
+
+#include <cstdlib>
+#include <string>
+#include <typeinfo>
+
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+namespace FilterLib {
+
+// Buffer name and size, the class name for any other node
+template<typename T>
+std::string nodeName(const ProcessChain<T>* node) {
+	auto buffer = dynamic_cast<const Buffer<T>*>(node);
+	if (buffer != nullptr) {
+		std::stringstream ss;
+		ss << buffer->name() << "[" << buffer->size() << "]";
+		return ss.str();
+	}
+	const char* name = typeid(*node).name();
+#if defined(__GNUC__)
+	int status = 0;
+	char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+	if (demangled != nullptr) {
+		std::string result(demangled);
+		std::free(demangled);
+		return result;
+	}
+#endif
+	return name;
+}
+
+template<typename T>
+struct ProfileEntry {
+	const ProcessChain<T>* node;
+	size_t depth; // children are one deeper than their parent
+	NodeProfile profile;
+};
+
+// root, its simblings and everything below them, in the order in() runs
+// them
+template<typename T>
+std::vector<ProfileEntry<T>> profileGraph(const ProcessChain<T>* root) {
+	std::vector<ProfileEntry<T>> entries;
+	std::vector<std::pair<const ProcessChain<T>*, size_t>> stack(1, { root, 0 });
+	while (!stack.empty()) {
+		auto item = stack.back();
+		stack.pop_back();
+		entries.push_back({ item.first, item.second, item.first->profile() });
+		if (item.first->first() != nullptr)
+			stack.push_back({ item.first->first(), item.second + 1 });
+		if (item.first->next() != nullptr)
+			stack.push_back({ item.first->next(), item.second });
+	}
+	return entries;
+}
+
+template<typename T>
+void resetProfile(ProcessChain<T>* root) {
+	for (auto& entry : profileGraph<T>(root))
+		const_cast<ProcessChain<T>*>(entry.node)->resetProfile();
+}
+
+// one line per node: calls, samples, ticks in total, per sample and at
+// most per call, p50 and p99 per call from the histogram, share of the
+// total
+template<typename T>
+std::string profileTable(const ProcessChain<T>* root) {
+	auto entries = profileGraph(root);
+	uint64_t total = profileTotal(root);
+	std::stringstream ss;
+	ss << std::left << std::setw(32) << "node" << std::right
+		<< std::setw(10) << "calls" << std::setw(12) << "samples"
+		<< std::setw(14) << "ticks" << std::setw(10) << "/sample"
+		<< std::setw(10) << "max" << std::setw(10) << "p50"
+		<< std::setw(10) << "p99" << std::setw(8) << "share" << std::endl;
+	for (auto& entry : entries) {
+		const NodeProfile& p = entry.profile;
+		std::string name = std::string(2 * entry.depth, ' ') + nodeName(entry.node);
+		ss << std::left << std::setw(32) << name << std::right
+			<< std::setw(10) << p.calls << std::setw(12) << p.samples
+			<< std::setw(14) << p.total << std::fixed << std::setprecision(1)
+			<< std::setw(10) << ((p.samples > 0) ? double(p.total) / double(p.samples) : 0.)
+			<< std::setw(10) << p.max << std::setw(10) << p.percentile(0.5)
+			<< std::setw(10) << p.percentile(0.99)
+			<< std::setw(7) << ((total > 0) ? 100. * double(p.total) / double(total) : 0.)
+			<< '%' << std::endl;
+	}
+	return ss.str();
+}
+
+template<typename T>
+std::string profileJson(const ProcessChain<T>* root) {
+	auto entries = profileGraph(root);
+	std::stringstream ss;
+#ifdef FILTERLIB_TSC
+	ss << "{\"ticks\": \"cycles\", \"nodes\": [";
+#else
+	ss << "{\"ticks\": \"ns\", \"nodes\": [";
+#endif
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const NodeProfile& p = entries[i].profile;
+		std::string name = nodeName(entries[i].node);
+		std::string escaped;
+		for (char c : name) {
+			if (c == '"' || c == '\\')
+				escaped += '\\';
+			escaped += c;
+		}
+		ss << ((i > 0) ? "," : "") << std::endl
+			<< "  {\"node\": \"" << escaped << "\", \"depth\": " << entries[i].depth
+			<< ", \"calls\": " << p.calls << ", \"samples\": " << p.samples
+			<< ", \"total\": " << p.total << ", \"max\": " << p.max
+			<< ", \"histogram\": [";
+		// trailing empty buckets left out
+		size_t used = NodeProfile::buckets;
+		while (used > 0 && p.histogram[used - 1] == 0)
+			--used;
+		for (size_t b = 0; b < used; ++b)
+			ss << ((b > 0) ? ", " : "") << p.histogram[b];
+		ss << "]}";
+	}
+	ss << std::endl << "]}" << std::endl;
+	return ss.str();
+}
+
+}
+
+#endif // PROFILE_H
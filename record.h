@@ -0,0 +1,570 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "filter.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace FilterLib {
+
+enum ValueEncoding
+{
+	RawValues = 0,
+	XorValues, // Gorilla: xor with the previous value, only its changed bits
+};
+
+// file layout: RecordHeader, then chunks of up to RecordHeader::chunk
+// samples, each a RecordChunk followed by its time and its value stream.
+// Times are the bits of time_t, delta of delta, zigzag, varint. Values
+// are plain or xor coded, the latter needs 4 or 8 byte values. Every
+// chunk starts from scratch so it decodes on its own
+struct RecordHeader {
+	static constexpr uint64_t signature = 0x31434552544c4946; // "FILTREC1"
+	static constexpr uint32_t revision = 1;
+
+	uint64_t magic;
+	uint32_t version;
+	uint32_t element; // elementTag<T>() of the values
+	uint32_t encoding;
+	uint32_t chunk;
+};
+
+struct RecordChunk {
+	uint32_t count;
+	uint32_t timeBytes;
+	uint32_t valueBytes;
+};
+
+static_assert(sizeof(time_t) == sizeof(uint32_t), "time_t is recorded as 32 bits");
+
+template<size_t Size>
+struct RecordBits {
+	typedef void type; // no xor coding
+};
+
+template<>
+struct RecordBits<4> {
+	typedef uint32_t type;
+};
+
+template<>
+struct RecordBits<8> {
+	typedef uint64_t type;
+};
+
+// msb first bit stream for the xor coded values
+class BitWriter {
+public:
+	explicit BitWriter(std::vector<uint8_t>& output) :
+		m_output(output),
+		m_acc(0),
+		m_bits(0)
+	{
+
+	}
+
+	inline void write(uint64_t value, unsigned n) {
+		if (n > 32) {
+			write(value >> 32, n - 32);
+			n = 32;
+		}
+		m_acc = (m_acc << n) | (value & ((uint64_t(1) << n) - 1));
+		m_bits += n;
+		while (m_bits >= 8) {
+			m_bits -= 8;
+			m_output.push_back(uint8_t(m_acc >> m_bits));
+		}
+	}
+
+	inline void flush() {
+		if (m_bits > 0)
+			m_output.push_back(uint8_t(m_acc << (8 - m_bits)));
+		m_bits = 0;
+	}
+
+protected:
+	std::vector<uint8_t>& m_output;
+	uint64_t m_acc;
+	unsigned m_bits;
+};
+
+class BitReader {
+public:
+	BitReader(const uint8_t* input, const uint8_t* end) :
+		m_input(input),
+		m_end(end),
+		m_acc(0),
+		m_bits(0)
+	{
+
+	}
+
+	inline uint64_t read(unsigned n) {
+		if (n > 32) {
+			uint64_t high = read(n - 32);
+			return (high << 32) | read(32);
+		}
+		while (m_bits < n) {
+			m_acc = (m_acc << 8) | ((m_input < m_end) ? *m_input++ : 0);
+			m_bits += 8;
+		}
+		m_bits -= n;
+		return (m_acc >> m_bits) & ((uint64_t(1) << n) - 1);
+	}
+
+protected:
+	const uint8_t *m_input, *m_end;
+	uint64_t m_acc;
+	unsigned m_bits;
+};
+
+inline uint32_t timeBits(time_t time) {
+	uint32_t bits;
+	std::memcpy(&bits, &time, sizeof(bits));
+	return bits;
+}
+
+inline time_t bitsTime(uint32_t bits) {
+	time_t time;
+	std::memcpy(&time, &bits, sizeof(time));
+	return time;
+}
+
+inline void writeVarint(std::vector<uint8_t>& output, uint64_t value) {
+	while (value >= 0x80) {
+		output.push_back(uint8_t(value | 0x80));
+		value >>= 7;
+	}
+	output.push_back(uint8_t(value));
+}
+
+inline uint64_t readVarint(const uint8_t*& input, const uint8_t* end) {
+	uint64_t value = 0;
+	for (unsigned shift = 0; input < end && shift < 64; shift += 7) {
+		uint8_t byte = *input++;
+		value |= uint64_t(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			break;
+	}
+	return value;
+}
+
+// child node writing every (time, value) it sees to a file, time is the
+// front of the time reference at the time the sample passes, as for a
+// NuBuffer hanging off the same parent. Samples are coded in chunks and
+// reach the file once a chunk is full or on flush()
+template<typename T>
+class Recorder :
+	public NuFilter<T>
+{
+public:
+	static constexpr size_t chunk = 4096;
+
+	static_assert(std::is_trivially_copyable<T>::value,
+		"Recorder needs trivially copyable values");
+
+	Recorder(const std::string& path, Buffer<time_t>* timeRef,
+		ValueEncoding encoding = RawValues,
+		ProcessChain<T>* parent = nullptr) :
+		NuFilter<T>(timeRef, parent),
+		m_path(path),
+		m_encoding(std::is_void<Bits>::value ? RawValues : encoding),
+		m_samples(0),
+		m_bytes(0)
+	{
+		m_file = std::fopen(path.c_str(), "wb");
+		if (m_file == nullptr)
+			throw std::system_error(errno, std::generic_category(), "fopen " + path);
+		RecordHeader header = { RecordHeader::signature, RecordHeader::revision,
+			elementTag<T>(), uint32_t(m_encoding), uint32_t(chunk) };
+		write(&header, sizeof(header));
+		m_times.reserve(chunk);
+		m_values.reserve(chunk);
+		// worst cases: 5 byte varints, 14 bits of xor control per value
+		m_timeStream.reserve(chunk * 5);
+		m_valueStream.reserve(chunk * (sizeof(T) + 2) + 16);
+	}
+
+	~Recorder() {
+		try {
+			flush();
+		} catch (const std::system_error&) {
+			// nowhere to report it from here, call flush() to see it
+		}
+		std::fclose(m_file);
+	}
+
+	Recorder(const Recorder&) = delete;
+	Recorder& operator=(const Recorder&) = delete;
+
+	inline const std::string& path() const { return m_path; }
+	// xor falls back to raw for values other than 4 or 8 bytes
+	inline ValueEncoding encoding() const { return m_encoding; }
+	inline size_t samples() const { return m_samples; }
+	// bytes in the file so far, flush() first for all of them
+	inline size_t bytes() const { return m_bytes; }
+
+	inline void flush() {
+		if (!m_times.empty())
+			encode();
+		std::fflush(m_file);
+	}
+
+protected:
+	typedef typename RecordBits<sizeof(T)>::type Bits;
+
+	std::string m_path;
+	ValueEncoding m_encoding;
+	std::FILE* m_file;
+	size_t m_samples, m_bytes;
+	std::vector<time_t> m_times;
+	std::vector<T> m_values;
+	std::vector<uint8_t> m_timeStream, m_valueStream;
+
+	inline T process(const T& input) override {
+		append(this->m_timeRef->front(), input);
+		return input;
+	}
+
+	// the time reference got the whole block already, it only still holds
+	// the times of blocks up to its size
+	inline const T* processBlock(const T* input, size_t n) override {
+		if (n > this->m_timeRef->size())
+			throw std::length_error("Recorder: block larger than the time reference");
+		RingView<const time_t> times = this->m_timeRef->view(n);
+		for (size_t i = 0; i < times.first.size; ++i)
+			append(times.first[i], input[i]);
+		input += times.first.size;
+		for (size_t i = 0; i < times.second.size; ++i)
+			append(times.second[i], input[i]);
+		return input - times.first.size;
+	}
+
+	inline void append(time_t time, const T& value) {
+		m_times.push_back(time);
+		m_values.push_back(value);
+		++m_samples;
+		if (m_times.size() == chunk)
+			encode();
+	}
+
+	inline void encode() {
+		size_t n = m_times.size();
+		m_timeStream.clear();
+		m_valueStream.clear();
+
+		uint32_t previous = timeBits(m_times[0]);
+		int64_t delta = 0;
+		writeVarint(m_timeStream, previous);
+		for (size_t i = 1; i < n; ++i) {
+			uint32_t bits = timeBits(m_times[i]);
+			int64_t next = int64_t(bits) - int64_t(previous);
+			int64_t dod = next - delta;
+			writeVarint(m_timeStream, (uint64_t(dod) << 1) ^ uint64_t(dod >> 63));
+			delta = next;
+			previous = bits;
+		}
+
+		if (m_encoding == XorValues) {
+			encodeXor(static_cast<Bits*>(nullptr));
+		} else {
+			m_valueStream.resize(n * sizeof(T));
+			std::memcpy(m_valueStream.data(), m_values.data(), n * sizeof(T));
+		}
+
+		RecordChunk header = { uint32_t(n), uint32_t(m_timeStream.size()),
+			uint32_t(m_valueStream.size()) };
+		write(&header, sizeof(header));
+		write(m_timeStream.data(), m_timeStream.size());
+		write(m_valueStream.data(), m_valueStream.size());
+		m_times.clear();
+		m_values.clear();
+	}
+
+	inline void encodeXor(void*) { }
+
+	// '0' same value, '10' changed bits inside the previous window,
+	// '11' 6 bits leading zeros, 6 bits length - 1, then the changed bits
+	template<typename U>
+	inline void encodeXor(U*) {
+		const unsigned width = sizeof(U) * 8;
+		BitWriter writer(m_valueStream);
+		U previous;
+		std::memcpy(&previous, &m_values[0], sizeof(U));
+		writer.write(previous, width);
+		unsigned leading = width + 1, trailing = 0;
+		for (size_t i = 1; i < m_values.size(); ++i) {
+			U bits;
+			std::memcpy(&bits, &m_values[i], sizeof(U));
+			U x = bits ^ previous;
+			previous = bits;
+			if (x == 0) {
+				writer.write(0, 1);
+				continue;
+			}
+			unsigned lead = leadingZeros(x), trail = trailingZeros(x);
+			if (leading <= width && lead >= leading && trail >= trailing) {
+				writer.write(2, 2);
+				writer.write(x >> trailing, width - leading - trailing);
+			} else {
+				leading = lead;
+				trailing = trail;
+				writer.write(3, 2);
+				writer.write(leading, 6);
+				writer.write(width - leading - trailing - 1, 6);
+				writer.write(x >> trailing, width - leading - trailing);
+			}
+		}
+		writer.flush();
+	}
+
+	static inline unsigned leadingZeros(uint32_t x) {
+#if defined(__GNUC__)
+		return unsigned(__builtin_clz(x));
+#else
+		unsigned n = 0;
+		for (uint32_t bit = uint32_t(1) << 31; !(x & bit); bit >>= 1)
+			++n;
+		return n;
+#endif
+	}
+
+	static inline unsigned leadingZeros(uint64_t x) {
+		uint32_t high = uint32_t(x >> 32);
+		return high ? leadingZeros(high) : 32 + leadingZeros(uint32_t(x));
+	}
+
+	static inline unsigned trailingZeros(uint64_t x) {
+#if defined(__GNUC__)
+		return unsigned(__builtin_ctzll(x));
+#else
+		unsigned n = 0;
+		for (; !(x & 1); x >>= 1)
+			++n;
+		return n;
+#endif
+	}
+
+	inline void write(const void* data, size_t size) {
+		if (size > 0 && std::fwrite(data, 1, size, m_file) != size)
+			throw std::system_error(errno, std::generic_category(), "fwrite " + m_path);
+		m_bytes += size;
+	}
+};
+
+template<typename T>
+constexpr size_t Recorder<T>::chunk;
+
+// feeds a recording into a time Buffer and the value chain of its
+// NuBuffers as fast as it decodes, block by block like Ingest does. The
+// file is mapped when possible and read whole otherwise
+template<typename T>
+class Replayer {
+public:
+	explicit Replayer(const std::string& path) :
+		m_path(path),
+		m_mapped(nullptr),
+		m_length(0),
+		m_seconds(0),
+		m_replayed(0)
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw std::system_error(errno, std::generic_category(), "open " + path);
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			m_length = size_t(info.st_size);
+			void* address = mmap(nullptr, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (address != MAP_FAILED) {
+				m_mapped = address;
+				madvise(address, m_length, MADV_SEQUENTIAL);
+			}
+		}
+		if (m_mapped == nullptr) {
+			char block[1 << 16];
+			ssize_t n;
+			while ((n = ::read(fd, block, sizeof(block))) > 0)
+				m_contents.insert(m_contents.end(), block, block + n);
+			m_length = m_contents.size();
+		}
+		close(fd);
+
+		RecordHeader header;
+		const char* reason = nullptr;
+		if (m_length < sizeof(header))
+			reason = "no record header";
+		else if (std::memcpy(&header, begin(), sizeof(header)),
+			header.magic != RecordHeader::signature || header.version != RecordHeader::revision)
+			reason = "not a recording";
+		else if (header.element != elementTag<T>())
+			reason = "element type differs";
+		if (reason != nullptr) {
+			if (m_mapped != nullptr)
+				munmap(m_mapped, m_length);
+			invalid(reason);
+		}
+		m_encoding = ValueEncoding(header.encoding);
+	}
+
+	~Replayer() {
+		if (m_mapped != nullptr)
+			munmap(m_mapped, m_length);
+	}
+
+	Replayer(const Replayer&) = delete;
+	Replayer& operator=(const Replayer&) = delete;
+
+	inline ValueEncoding encoding() const { return m_encoding; }
+	inline size_t bytes() const { return m_length; }
+	inline bool mapped() const { return m_mapped != nullptr; }
+
+	// samples the last replay() pushed and how fast
+	inline size_t replayed() const { return m_replayed; }
+	inline double seconds() const { return m_seconds; }
+	inline double samplesPerSecond() const {
+		return (m_seconds > 0) ? double(m_replayed) / m_seconds : 0.;
+	}
+
+	// whole recording, in blocks of at most block samples: first into
+	// timeRef, then into input. Blocks are cut to the size of timeRef so
+	// nodes below input still find their times there. Returns the number
+	// of samples
+	inline size_t replay(Buffer<time_t>* timeRef, ProcessChain<T>* input,
+		size_t block = 4096) {
+		ASSERT(timeRef != nullptr && input != nullptr && block > 0);
+		block = std::min(block, timeRef->size());
+		auto start = std::chrono::steady_clock::now();
+		m_replayed = 0;
+		const uint8_t* position = begin() + sizeof(RecordHeader);
+		while (position < end()) {
+			size_t n = decode(position);
+			for (size_t i = 0; i < n; i += block) {
+				size_t k = std::min(block, n - i);
+				timeRef->in(m_times.data() + i, k);
+				input->in(m_values.data() + i, k);
+			}
+			m_replayed += n;
+		}
+		m_seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+		return m_replayed;
+	}
+
+	// whole recording into vectors, oldest first
+	inline size_t read(std::vector<time_t>& times, std::vector<T>& values) {
+		times.clear();
+		values.clear();
+		const uint8_t* position = begin() + sizeof(RecordHeader);
+		while (position < end()) {
+			size_t n = decode(position);
+			times.insert(times.end(), m_times.begin(), m_times.begin() + n);
+			values.insert(values.end(), m_values.begin(), m_values.begin() + n);
+		}
+		return times.size();
+	}
+
+protected:
+	typedef typename RecordBits<sizeof(T)>::type Bits;
+
+	std::string m_path;
+	void* m_mapped;
+	size_t m_length;
+	std::vector<uint8_t> m_contents;
+	ValueEncoding m_encoding;
+	std::vector<time_t> m_times;
+	std::vector<T> m_values;
+	double m_seconds;
+	size_t m_replayed;
+
+	inline const uint8_t* begin() const {
+		return (m_mapped != nullptr) ?
+			static_cast<const uint8_t*>(m_mapped) :
+			m_contents.data();
+	}
+	inline const uint8_t* end() const { return begin() + m_length; }
+
+	// the chunk at position into m_times and m_values, moves past it
+	inline size_t decode(const uint8_t*& position) {
+		RecordChunk chunk;
+		if (size_t(end() - position) < sizeof(chunk))
+			invalid("truncated chunk");
+		std::memcpy(&chunk, position, sizeof(chunk));
+		position += sizeof(chunk);
+		if (size_t(end() - position) < size_t(chunk.timeBytes) + chunk.valueBytes)
+			invalid("truncated chunk");
+		size_t n = chunk.count;
+		if (m_times.size() < n) {
+			m_times.resize(n);
+			m_values.resize(n);
+		}
+
+		const uint8_t* times = position;
+		const uint8_t* timesEnd = times + chunk.timeBytes;
+		uint32_t previous = uint32_t(readVarint(times, timesEnd));
+		int64_t delta = 0;
+		if (n > 0)
+			m_times[0] = bitsTime(previous);
+		for (size_t i = 1; i < n; ++i) {
+			uint64_t zigzag = readVarint(times, timesEnd);
+			int64_t dod = int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+			delta += dod;
+			previous = uint32_t(int64_t(previous) + delta);
+			m_times[i] = bitsTime(previous);
+		}
+		position = timesEnd;
+
+		if (m_encoding == XorValues) {
+			decodeXor(static_cast<Bits*>(nullptr), position, chunk.valueBytes, n);
+		} else {
+			if (chunk.valueBytes != n * sizeof(T))
+				invalid("value size differs");
+			std::memcpy(m_values.data(), position, n * sizeof(T));
+		}
+		position += chunk.valueBytes;
+		return n;
+	}
+
+	inline void decodeXor(void*, const uint8_t*, size_t, size_t) {
+		invalid("xor coding needs 4 or 8 byte values");
+	}
+
+	template<typename U>
+	inline void decodeXor(U*, const uint8_t* input, size_t bytes, size_t n) {
+		const unsigned width = sizeof(U) * 8;
+		BitReader reader(input, input + bytes);
+		if (n == 0)
+			return;
+		U previous = U(reader.read(width));
+		std::memcpy(&m_values[0], &previous, sizeof(U));
+		unsigned leading = 0, trailing = 0;
+		for (size_t i = 1; i < n; ++i) {
+			if (reader.read(1)) {
+				if (reader.read(1)) {
+					leading = unsigned(reader.read(6));
+					trailing = width - leading - unsigned(reader.read(6)) - 1;
+				}
+				previous ^= U(reader.read(width - leading - trailing)) << trailing;
+			}
+			std::memcpy(&m_values[i], &previous, sizeof(U));
+		}
+	}
+
+	inline void invalid(const char* reason) const {
+		throw std::runtime_error(m_path + ": " + reason);
+	}
+};
+
+}
+
+#endif // RECORD_H
@@ -0,0 +1,435 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "fixed.h"
+
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FILTERLIB_X86
+#define FILTERLIB_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define FILTERLIB_X86
+#define FILTERLIB_TARGET(isa)
+#endif
+
+namespace FilterLib {
+
+namespace simd {
+
+enum Isa
+{
+	Scalar = 0,
+	SSE2,
+	AVX2,
+	AVX512,
+};
+
+template<typename T>
+inline T dotScalar(const T* a, const T* b, std::size_t n) {
+	T s0 = T(), s1 = T(), s2 = T(), s3 = T();
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		s0 += a[i] * b[i];
+		s1 += a[i + 1] * b[i + 1];
+		s2 += a[i + 2] * b[i + 2];
+		s3 += a[i + 3] * b[i + 3];
+	}
+	for (; i < n; ++i)
+		s0 += a[i] * b[i];
+	return (s0 + s1) + (s2 + s3);
+}
+
+// output[i] = a[i] * (1 - u[i]) + b[i] * u[i], the weights in float as
+// Buffer_T mixes them
+template<typename T>
+inline void mixScalar(const T* a, const T* b, const float* u, T* output, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i)
+		output[i] = a[i] * (1.f - u[i]) + b[i] * u[i];
+}
+
+template<typename F>
+inline void mixFixed(const F* a, const F* b, const float* u, F* output, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i)
+		output[i] = F::mix(a[i], b[i], u[i]);
+}
+
+#ifdef FILTERLIB_X86
+
+FILTERLIB_TARGET("sse2")
+inline float dotSSE2(const float* a, const float* b, std::size_t n) {
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	s0 = _mm_add_ps(s0, s1);
+	s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+	s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+	float s = _mm_cvtss_f32(s0);
+	for (; i < n; ++i)
+		s += a[i] * b[i];
+	return s;
+}
+
+FILTERLIB_TARGET("avx2,fma")
+inline float dotAVX2(const float* a, const float* b, std::size_t n) {
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	__m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+	std::size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+		s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+		s2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), s2);
+		s3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), s3);
+	}
+	s0 = _mm256_add_ps(s0, s2);
+	s1 = _mm256_add_ps(s1, s3);
+	for (; i + 8 <= n; i += 8)
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+	if (i < n) {
+		// lanes below the remaining count load, the rest read as zero
+		const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(int(n - i)), lanes);
+		s1 = _mm256_fmadd_ps(_mm256_maskload_ps(a + i, mask),
+			_mm256_maskload_ps(b + i, mask), s1);
+	}
+	s0 = _mm256_add_ps(s0, s1);
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+
+// the mix kernels multiply and add separately, without fma, so they give
+// the same bits as mixScalar
+
+FILTERLIB_TARGET("sse2")
+inline void mixSSE2(const float* a, const float* b, const float* u, float* output,
+	std::size_t n) {
+	const __m128 one = _mm_set1_ps(1.f);
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 w = _mm_loadu_ps(u + i);
+		_mm_storeu_ps(output + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + i), _mm_sub_ps(one, w)),
+			_mm_mul_ps(_mm_loadu_ps(b + i), w)));
+	}
+	mixScalar(a + i, b + i, u + i, output + i, n - i);
+}
+
+FILTERLIB_TARGET("sse2")
+inline void mixSSE2(const double* a, const double* b, const float* u, double* output,
+	std::size_t n) {
+	const __m128 one = _mm_set1_ps(1.f);
+	std::size_t i = 0;
+	for (; i + 2 <= n; i += 2) {
+		// two floats into the low half, __m64 may alias them
+		__m128 w = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(u + i));
+		__m128d wa = _mm_cvtps_pd(_mm_sub_ps(one, w)), wb = _mm_cvtps_pd(w);
+		_mm_storeu_pd(output + i, _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(a + i), wa),
+			_mm_mul_pd(_mm_loadu_pd(b + i), wb)));
+	}
+	mixScalar(a + i, b + i, u + i, output + i, n - i);
+}
+
+FILTERLIB_TARGET("avx2")
+inline void mixAVX2(const float* a, const float* b, const float* u, float* output,
+	std::size_t n) {
+	const __m256 one = _mm256_set1_ps(1.f);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 w = _mm256_loadu_ps(u + i);
+		_mm256_storeu_ps(output + i, _mm256_add_ps(
+			_mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_sub_ps(one, w)),
+			_mm256_mul_ps(_mm256_loadu_ps(b + i), w)));
+	}
+	mixSSE2(a + i, b + i, u + i, output + i, n - i);
+}
+
+FILTERLIB_TARGET("avx2")
+inline void mixAVX2(const double* a, const double* b, const float* u, double* output,
+	std::size_t n) {
+	const __m128 one = _mm_set1_ps(1.f);
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 w = _mm_loadu_ps(u + i);
+		__m256d wa = _mm256_cvtps_pd(_mm_sub_ps(one, w)), wb = _mm256_cvtps_pd(w);
+		_mm256_storeu_pd(output + i, _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(a + i), wa),
+			_mm256_mul_pd(_mm256_loadu_pd(b + i), wb)));
+	}
+	mixSSE2(a + i, b + i, u + i, output + i, n - i);
+}
+
+// Q15 steps in double like Q15::mix, rounding to even as llrint does
+FILTERLIB_TARGET("avx2")
+inline void mixAVX2(const Q15* a, const Q15* b, const float* u, Q15* output,
+	std::size_t n) {
+	static_assert(sizeof(Q15) == sizeof(int16_t), "Q15 is not one int16_t");
+	const int16_t* x = reinterpret_cast<const int16_t*>(a);
+	const int16_t* y = reinterpret_cast<const int16_t*>(b);
+	int16_t* z = reinterpret_cast<int16_t*>(output);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i xa = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+		__m256i xb = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i)));
+		__m256i d = _mm256_sub_epi32(xb, xa);
+		__m256 w = _mm256_loadu_ps(u + i);
+		__m128i lo = _mm256_cvtpd_epi32(_mm256_mul_pd(
+			_mm256_cvtepi32_pd(_mm256_castsi256_si128(d)), _mm256_cvtps_pd(_mm256_castps256_ps128(w))));
+		__m128i hi = _mm256_cvtpd_epi32(_mm256_mul_pd(
+			_mm256_cvtepi32_pd(_mm256_extracti128_si256(d, 1)), _mm256_cvtps_pd(_mm256_extractf128_ps(w, 1))));
+		__m256i r = _mm256_add_epi32(xa, _mm256_set_m128i(hi, lo));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(z + i),
+			_mm_packs_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1)));
+	}
+	mixFixed(a + i, b + i, u + i, output + i, n - i);
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+// gcc 12 avx512 intrinsics start from undefined vectors
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#ifndef __clang__
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#endif
+
+FILTERLIB_TARGET("avx512f")
+inline float dotAVX512(const float* a, const float* b, std::size_t n) {
+	__m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+	__m512 s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+	std::size_t i = 0;
+	for (; i + 64 <= n; i += 64) {
+		s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+		s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), s1);
+		s2 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32), s2);
+		s3 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48), s3);
+	}
+	s0 = _mm512_add_ps(s0, s2);
+	s1 = _mm512_add_ps(s1, s3);
+	for (; i + 16 <= n; i += 16)
+		s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+	if (i < n) {
+		__mmask16 mask = __mmask16((1u << (n - i)) - 1);
+		s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i),
+			_mm512_maskz_loadu_ps(mask, b + i), s1);
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(s0, s1));
+}
+
+// avx512f has fma, gcc would fuse plain _mm512_mul_ps and _mm512_add_ps
+// into one and round differently, the explicit rounding forms it leaves
+// alone
+#define FILTERLIB_ROUND _MM_FROUND_CUR_DIRECTION
+
+FILTERLIB_TARGET("avx512f")
+inline void mixAVX512(const float* a, const float* b, const float* u, float* output,
+	std::size_t n) {
+	const __m512 one = _mm512_set1_ps(1.f);
+	std::size_t i = 0;
+	for (; i < n; i += 16) {
+		__mmask16 mask = (n - i >= 16) ? __mmask16(0xffff) : __mmask16((1u << (n - i)) - 1);
+		__m512 w = _mm512_maskz_loadu_ps(mask, u + i), v = _mm512_sub_ps(one, w);
+		__m512 x = _mm512_mul_round_ps(_mm512_maskz_loadu_ps(mask, a + i), v, FILTERLIB_ROUND);
+		__m512 y = _mm512_mul_round_ps(_mm512_maskz_loadu_ps(mask, b + i), w, FILTERLIB_ROUND);
+		_mm512_mask_storeu_ps(output + i, mask, _mm512_add_round_ps(x, y, FILTERLIB_ROUND));
+	}
+}
+
+FILTERLIB_TARGET("avx512f")
+inline void mixAVX512(const double* a, const double* b, const float* u, double* output,
+	std::size_t n) {
+	const __m256 one = _mm256_set1_ps(1.f);
+	std::size_t i = 0;
+	// the tail masked too, a scalar remainder inlined here would be fused
+	for (; i < n; i += 8) {
+		__mmask8 mask = (n - i >= 8) ? __mmask8(0xff) : __mmask8((1u << (n - i)) - 1);
+		__m256 w = _mm512_castps512_ps256(_mm512_maskz_loadu_ps(__mmask16(mask), u + i));
+		__m512d wa = _mm512_cvtps_pd(_mm256_sub_ps(one, w)), wb = _mm512_cvtps_pd(w);
+		__m512d x = _mm512_mul_round_pd(_mm512_maskz_loadu_pd(mask, a + i), wa, FILTERLIB_ROUND);
+		__m512d y = _mm512_mul_round_pd(_mm512_maskz_loadu_pd(mask, b + i), wb, FILTERLIB_ROUND);
+		_mm512_mask_storeu_pd(output + i, mask, _mm512_add_round_pd(x, y, FILTERLIB_ROUND));
+	}
+}
+
+#undef FILTERLIB_ROUND
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+inline Isa detect() {
+#if defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SSE2;
+	return Scalar;
+#else
+	int info[4];
+	__cpuid(info, 0);
+	int top = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool ymm = (xcr0 & 0x06) == 0x06, zmm = (xcr0 & 0xe6) == 0xe6;
+	bool avx2 = false, avx512 = false;
+	if (top >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+		avx512 = (info[1] & (1 << 16)) != 0;
+	}
+	if (avx512 && zmm)
+		return AVX512;
+	if (avx2 && fma && ymm)
+		return AVX2;
+	return sse2 ? SSE2 : Scalar;
+#endif
+}
+
+#else
+
+inline Isa detect() {
+	return Scalar;
+}
+
+#endif
+
+// best instruction set of this machine, probed once
+inline Isa isa() {
+	static const Isa value = detect();
+	return value;
+}
+
+template<typename T>
+struct Kernel {
+	typedef T (*Dot)(const T*, const T*, std::size_t);
+
+	static Dot dot(Isa isa = simd::isa()) {
+		(void)(isa);
+		return &dotScalar<T>;
+	}
+};
+
+template<>
+struct Kernel<float> {
+	typedef float (*Dot)(const float*, const float*, std::size_t);
+
+	// isa is capped to what the machine supports
+	static Dot dot(Isa isa = simd::isa()) {
+		isa = (isa < simd::isa()) ? isa : simd::isa();
+		switch (isa)
+		{
+#ifdef FILTERLIB_X86
+		case AVX512:
+			return &dotAVX512;
+		case AVX2:
+			return &dotAVX2;
+		case SSE2:
+			return &dotSSE2;
+#endif
+		default:
+			return &dotScalar<float>;
+		}
+	}
+
+	typedef void (*Mix)(const float*, const float*, const float*, float*, std::size_t);
+
+	static Mix mix(Isa isa = simd::isa()) {
+		isa = (isa < simd::isa()) ? isa : simd::isa();
+		switch (isa)
+		{
+#ifdef FILTERLIB_X86
+		case AVX512:
+			return &mixAVX512;
+		case AVX2:
+			return &mixAVX2;
+		case SSE2:
+			return &mixSSE2;
+#endif
+		default:
+			return &mixScalar<float>;
+		}
+	}
+};
+
+template<>
+struct Kernel<double> {
+	typedef double (*Dot)(const double*, const double*, std::size_t);
+	typedef void (*Mix)(const double*, const double*, const float*, double*, std::size_t);
+
+	static Dot dot(Isa isa = simd::isa()) {
+		(void)(isa);
+		return &dotScalar<double>;
+	}
+
+	static Mix mix(Isa isa = simd::isa()) {
+		isa = (isa < simd::isa()) ? isa : simd::isa();
+		switch (isa)
+		{
+#ifdef FILTERLIB_X86
+		case AVX512:
+			return &mixAVX512;
+		case AVX2:
+			return &mixAVX2;
+		case SSE2:
+			return &mixSSE2;
+#endif
+		default:
+			return &mixScalar<double>;
+		}
+	}
+};
+
+// fixed point sums its products wide instead of saturating every step
+template<typename Raw, typename Wide, int Frac>
+struct Kernel<Fixed<Raw, Wide, Frac>> {
+	typedef Fixed<Raw, Wide, Frac> F;
+	typedef F (*Dot)(const F*, const F*, std::size_t);
+	typedef void (*Mix)(const F*, const F*, const float*, F*, std::size_t);
+
+	static Dot dot(Isa isa = simd::isa()) {
+		(void)(isa);
+		return &F::dot;
+	}
+
+	static Mix mix(Isa isa = simd::isa()) {
+		(void)(isa);
+		return &mixFixed<F>;
+	}
+};
+
+template<>
+struct Kernel<Q15> {
+	typedef Q15 (*Dot)(const Q15*, const Q15*, std::size_t);
+	typedef void (*Mix)(const Q15*, const Q15*, const float*, Q15*, std::size_t);
+
+	static Dot dot(Isa isa = simd::isa()) {
+		(void)(isa);
+		return &Q15::dot;
+	}
+
+	static Mix mix(Isa isa = simd::isa()) {
+		isa = (isa < simd::isa()) ? isa : simd::isa();
+#ifdef FILTERLIB_X86
+		if (isa >= AVX2)
+			return &mixAVX2;
+#endif
+		return &mixFixed<Q15>;
+	}
+};
+
+}
+
+}
+
+#endif // SIMD_H
@@ -53,9 +53,10 @@ int main(int argc, char *argv[])
 			chart.setAxisY(&axisY, series);
 
 			QVector<QPointF> points;
-			for (size_t i = 0; i<buffer->size(); ++i)
-				points.append({qreal(buffer->timeRef()->at(i)),
-							   qreal(buffer->at(i))});
+			auto pairs = buffer->pairs(NewestFirst);
+			for (size_t i = 0; i<pairs.size(); ++i)
+				points.append({qreal(pairs.time(i)),
+							   qreal(pairs.value(i))});
 			series->replace(points);
 		}
 
@@ -68,9 +69,10 @@ int main(int argc, char *argv[])
 			chart.setAxisY(&axisY, series);
 
 			QVector<QPointF> points;
-			for (size_t i = 0; i<buffer->size(); ++i)
-				points.append({qreal(buffer->timeRef()->at(i)),
-							   qreal(buffer->at(i))});
+			auto pairs = buffer->pairs(NewestFirst);
+			for (size_t i = 0; i<pairs.size(); ++i)
+				points.append({qreal(pairs.time(i)),
+							   qreal(pairs.value(i))});
 			series->replace(points);
 		}
 
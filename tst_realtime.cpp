@@ -0,0 +1,406 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <atomic>
+#include <new>
+#include <string>
+
+#include <unistd.h>
+
+#include "buffer.h"
+#include "filter.h"
+#include "convolution.h"
+#include "filterbank.h"
+#include "pipeline.h"
+#include "plan.h"
+#include "parallel.h"
+#include "ingest.h"
+#include "mapped.h"
+#include "record.h"
+
+using namespace std;
+using namespace FilterLib;
+
+// every allocation of the process while an Audit runs, from any thread.
+// glibc lets malloc itself be replaced, which also catches C code such
+// as stdio; elsewhere only operator new is seen
+static std::atomic<bool> g_auditing(false);
+static std::atomic<size_t> g_allocations(0);
+
+static inline void counted() {
+	if (g_auditing.load(std::memory_order_relaxed))
+		g_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+
+void* malloc(size_t size) {
+	counted();
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+	counted();
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+	counted();
+	return __libc_realloc(pointer, size);
+}
+}
+#define COUNT_NEW()
+#else
+#define COUNT_NEW() counted()
+#endif
+
+// gcc takes free() in the replacements for a mismatch once it inlines them
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+	COUNT_NEW();
+	void* pointer = std::malloc(size);
+	if (pointer == nullptr)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](size_t size) {
+	COUNT_NEW();
+	void* pointer = std::malloc(size);
+	if (pointer == nullptr)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+#ifdef __cpp_sized_deallocation
+void operator delete(void* pointer, size_t) noexcept { ::operator delete(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { ::operator delete[](pointer); }
+#endif
+
+class Audit {
+public:
+	Audit() {
+		g_allocations.store(0);
+		g_auditing.store(true);
+	}
+
+	~Audit() { g_auditing.store(false); }
+
+	inline size_t stop() {
+		g_auditing.store(false);
+		return g_allocations.load();
+	}
+};
+
+static const size_t maxBlock = 256;
+
+static inline float signal(size_t i) {
+	return float((i * 7919) % 1009) * 0.01f - 5.f + sinf(float(i) * 0.01f);
+}
+
+// every node type below one input, times in a separate Buffer as the
+// NuBuffer, Recorder and Ingest use them
+struct Graph {
+	static const float taps[1024];
+
+	std::string recordPath, mappedPath;
+	Buffer<float> clock{ 4096 };
+	Filter<float> input;
+	Buffer<float> buffer{ 64, &input };
+	StaticBuffer<float, 64> fixed{ &input };
+	NuBuffer<float> values{ 64, &clock, &input };
+	Comparator<float> comparator{ 0.f, &input };
+	Limiter<float> limiter{ &input };
+	EMAFilter<float> ema{ 0.2f, &input };
+	HoldHigh<float> high{ 64, &input };
+	HoldLow<float> low{ 64, &input };
+	HoldHigh<float, 64> fixedHigh{ &input };
+	ScanHoldHigh<float> scanHigh{ 64, &input };
+	ScanHoldLow<float> scanLow{ 64, &input };
+	MidAntiJitter<float> median{ 63, &input };
+	MidAntiJitter<float> longMedian{ RankFilter<float>::skiplistSize, &input };
+	HistAntiJitter<float> hist{ 64, 128, -10.f, 10.f, 0.05f, &input };
+	FIRFilter<float> fir{ 32, &input };
+	IIRFilter<float> iir{ 2, &input };
+	ConvolutionFilter<float> direct{ taps, 64, 64, Direct, &input };
+	ConvolutionFilter<float> partitioned{ taps, 1024, 64, Partitioned, &input };
+	Pipeline<Limiter<float>, EMAFilter<float>, Buffer<float>> pipeline{
+		Limiter<float>() | EMAFilter<float>(0.5f) | Buffer<float>(32) };
+	Buffer<float> tail{ 16, &median };
+	Recorder<float> recorder;
+	MappedBuffer<float> mapped;
+
+	Graph() :
+		recordPath("/tmp/filterlib_rt_" + std::to_string(getpid()) + ".rec"),
+		mappedPath("/tmp/filterlib_rt_" + std::to_string(getpid()) + ".buf"),
+		recorder(recordPath, &clock, XorValues, &input),
+		mapped(mappedPath, 256, &input)
+	{
+		pipeline.ProcessChain::setParent(&input);
+		comparator.setThreshold(-1.f, 1.f);
+		limiter.setLimit(-3.f, 3.f);
+		fir.setCoeff(taps);
+		iir.setButterworthLowpass(0.1);
+	}
+
+	~Graph() {
+		unlink(recordPath.c_str());
+		unlink(mappedPath.c_str());
+	}
+
+	inline void prepare() {
+		clock.prepare(maxBlock);
+		input.prepare(maxBlock);
+	}
+};
+
+const float Graph::taps[1024] = { 0.5f, 0.25f, 0.125f, 0.0625f };
+
+// per sample and blocks of changing size through in(), i counts samples
+template<typename Sample, typename Block>
+size_t drive(size_t samples, size_t& i, Sample sample, Block block) {
+	float times[maxBlock], inputs[maxBlock];
+	size_t end = i + samples, n = 1;
+	while (i < end) {
+		for (size_t k = 0; k < 64 && i < end; ++k, ++i)
+			sample(float(i) * 0.001f, signal(i));
+		n = (n * 5 + 3) % maxBlock + 1;
+		for (size_t k = 0; k < n; ++k) {
+			times[k] = float(i + k) * 0.001f;
+			inputs[k] = signal(i + k);
+		}
+		block(times, inputs, n);
+		i += n;
+	}
+	return i;
+}
+
+int main(int argc, char *argv[])
+{
+	(void)(argc);
+	(void)(argv);
+	int failed = 0;
+#ifndef FILTERLIB_REALTIME
+	cout << "built without FILTERLIB_REALTIME" << endl << endl;
+#endif
+
+	{
+		cout << "Audit:" << endl;
+		// the counter sees what it should
+		Audit audit;
+		std::vector<float> vector(100);
+		std::string string(100, 'x');
+		size_t allocations = audit.stop();
+		bool matches = allocations >= 2 && vector.size() + string.size() == 200;
+		cout << matches << endl;
+		failed += !matches;
+		cout << endl;
+	}
+
+	{
+		cout << "ProcessChain::in:" << endl;
+		// warmed up past the first recorder chunk, then no allocation at all
+		Graph graph;
+		graph.prepare();
+		size_t i = 0;
+		auto sample = [&](float t, float x) { graph.clock.in(t); graph.input.in(x); };
+		auto block = [&](const float* t, const float* x, size_t n) {
+			graph.clock.in(t, n);
+			graph.input.in(x, n);
+		};
+		drive(3 * Recorder<float>::chunk, i, sample, block);
+		Audit audit;
+		drive(20000, i, sample, block);
+		size_t allocations = audit.stop();
+		bool matches = allocations == 0;
+		cout << allocations << " allocations " << matches << endl;
+		failed += !matches;
+		cout << endl;
+	}
+
+	{
+		cout << "ExecutionPlan:" << endl;
+		Graph graph;
+		graph.prepare();
+		ExecutionPlan<float> times(&graph.clock);
+		ExecutionPlan<float> plan(&graph.input);
+		size_t i = 0;
+		auto sample = [&](float t, float x) { times.in(t); plan.in(x); };
+		auto block = [&](const float* t, const float* x, size_t n) {
+			times.in(t, n);
+			plan.in(x, n);
+		};
+		drive(3 * Recorder<float>::chunk, i, sample, block);
+		Audit audit;
+		drive(20000, i, sample, block);
+		size_t allocations = audit.stop();
+		bool matches = allocations == 0;
+		cout << allocations << " allocations " << matches << endl;
+		failed += !matches;
+		cout << endl;
+	}
+
+	{
+		cout << "ParallelExecutor:" << endl;
+		// worker threads count as well
+		Graph graph;
+		WorkStealingPool pool(2);
+		ParallelExecutor<float> executor(&graph.input, pool, 0);
+		graph.clock.prepare(maxBlock);
+		executor.prepare(maxBlock);
+		size_t i = 0;
+		auto sample = [&](float t, float x) { graph.clock.in(t); executor.in(x); };
+		auto block = [&](const float* t, const float* x, size_t n) {
+			graph.clock.in(t, n);
+			executor.in(x, n);
+		};
+		drive(3 * Recorder<float>::chunk, i, sample, block);
+		Audit audit;
+		drive(20000, i, sample, block);
+		size_t allocations = audit.stop();
+		bool matches = allocations == 0;
+		cout << allocations << " allocations " << matches << endl;
+		failed += !matches;
+		cout << endl;
+	}
+
+	{
+		cout << "Ingest:" << endl;
+		// pushes out of order, polls commit blocks of up to the queue size
+		Graph graph;
+		graph.clock.prepare(1024);
+		graph.input.prepare(1024);
+		Ingest<float> ingest(&graph.clock, &graph.input, 0.005f, 1024);
+		size_t i = 0;
+		auto run = [&](size_t samples) {
+			for (size_t end = i + samples; i < end; ++i) {
+				size_t k = i ^ 3; // swaps neighbours around
+				ingest.push(float(k) * 0.001f, signal(k));
+				if (i % 200 == 199)
+					ingest.poll();
+			}
+		};
+		run(3 * Recorder<float>::chunk);
+		Audit audit;
+		run(20000);
+		size_t allocations = audit.stop();
+		bool matches = allocations == 0 && ingest.dropped() == 0;
+		cout << allocations << " allocations " << matches << endl;
+		failed += !matches;
+		cout << endl;
+	}
+
+	{
+		cout << "FilterBank:" << endl;
+		const size_t channels = 8;
+		BankBuffer<float> input(channels, 64);
+		FilterBank<Limiter<float>> limiter(channels, &input);
+		FilterBank<Comparator<float>> comparator(channels, 0.f, &input);
+		FilterBank<EMAFilter<float>> ema(channels, 0.2f, &input);
+		FilterBank<HoldHigh<float>> high(channels, 64, &input);
+		FilterBank<HoldLow<float, 64>> low(channels, 64, &input);
+		FilterBank<IIRFilter<float>> iir(channels, 2, &input);
+		BankBuffer<float> output(channels, 64, &iir);
+		float frame[channels];
+		auto run = [&](size_t frames) {
+			for (size_t i = 0; i < frames; ++i) {
+				for (size_t c = 0; c < channels; ++c)
+					frame[c] = signal(i * channels + c);
+				input.in(frame);
+			}
+		};
+		run(1000);
+		Audit audit;
+		run(10000);
+		size_t allocations = audit.stop();
+		bool matches = allocations == 0;
+		cout << allocations << " allocations " << matches << endl;
+		failed += !matches;
+		cout << endl;
+	}
+
+	{
+		cout << "Arena:" << endl;
+		Graph graph;
+		graph.prepare();
+		Arena arena(true);
+		arena.adopt<float>(&graph.input);
+		size_t i = 0;
+		auto sample = [&](float t, float x) { graph.clock.in(t); graph.input.in(x); };
+		auto block = [&](const float* t, const float* x, size_t n) {
+			graph.clock.in(t, n);
+			graph.input.in(x, n);
+		};
+		drive(3 * Recorder<float>::chunk, i, sample, block);
+		Audit audit;
+		drive(20000, i, sample, block);
+		size_t allocations = audit.stop();
+		bool matches = allocations == 0;
+		cout << allocations << " allocations " << matches << endl;
+		failed += !matches;
+		cout << endl;
+	}
+
+	{
+		cout << "Natural spline:" << endl;
+		// the caller keeps the knots, batches after the first do not allocate
+		Graph graph;
+		graph.prepare();
+		size_t i = 0;
+		auto sample = [&](float t, float x) { graph.clock.in(t); graph.input.in(x); };
+		auto block = [&](const float* t, const float* x, size_t n) {
+			graph.clock.in(t, n);
+			graph.input.in(x, n);
+		};
+		drive(3 * Recorder<float>::chunk, i, sample, block);
+		float times[64], output[64];
+		for (size_t k = 0; k < 64; ++k)
+			times[k] = graph.clock[63] + float(k) * 0.001f;
+		float index[2] = { 0.5f, 3.5f }, indexOutput[2];
+		SplineKnots knots;
+		graph.values.atTime(times, output, 64, knots);
+		graph.buffer.sample(index, indexOutput, 2, knots);
+		Audit audit;
+		graph.values.atTime(times, output, 64, knots);
+		graph.buffer.sample(index, indexOutput, 2, knots);
+		size_t allocations = audit.stop();
+		bool matches = allocations == 0 &&
+			output[7] == graph.values.atTime(times[7], NaturalSpline) &&
+			indexOutput[1] == graph.buffer.sample(3.5f, NaturalSpline);
+		cout << allocations << " allocations " << matches << endl;
+		failed += !matches;
+		cout << endl;
+	}
+
+#ifdef FILTERLIB_REALTIME
+	{
+		cout << "Unprepared block:" << endl;
+		// would have allocated, refused instead
+		Buffer<float> root(16);
+		HoldHigh<float> high(8, &root);
+		root.prepare(64);
+		std::vector<float> block(128, 1.f);
+		bool matches = false;
+		root.in(block.data(), 64);
+		try {
+			root.in(block.data(), block.size());
+		} catch (const std::length_error&) {
+			matches = true;
+		}
+		cout << matches << endl;
+		failed += !matches;
+		cout << endl;
+	}
+#endif
+
+	return failed;
+}